@@ -12,13 +12,70 @@
 // ----------------------------------------------------------------------------
 // Headers
 // ----------------------------------------------------------------------------
+#include <algorithm>
+#include <atomic>
+#include <bit>
 #include <cassert>
+#include <cerrno>
+#include <cmath>
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <deque>
 #include <format>
+#include <fstream>
+#include <functional>
+#include <latch>
+#include <limits>
 #include <list>
+#include <memory>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <shared_mutex>
 #include <stack>
+#include <thread>
 #include <source_location>
+#include <span>
+#include <utility>
 #include <vector>
 
+#if defined( __linux__ )
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#if defined( TESTKIT_TRACK_ALLOCATIONS )
+#include <cstdlib>
+#include <new>
+#if defined( __linux__ )
+#include <cxxabi.h>
+#include <execinfo.h>
+#endif
+#endif
+
+#if defined( __x86_64__ ) || defined( __i386__ )
+#include <cpuid.h>
+#include <x86intrin.h>
+#define TESTKIT_HAS_TSC
+#elif defined( _M_X64 ) || defined( _M_IX86 )
+#include <intrin.h>
+#define TESTKIT_HAS_TSC
+#endif
+
 // ----------------------------------------------------------------------------
 // Constants
 // ----------------------------------------------------------------------------
@@ -37,11 +94,37 @@
 // Forward Declaration
 // ----------------------------------------------------------------------------
 namespace TestKit { enum class Outcome; }
+namespace TestKit { enum class Backpressure; }
+namespace TestKit { struct AffinityGuard; }
+namespace TestKit { struct AsyncEvent; }
+namespace TestKit { struct AsyncExecutor; }
+namespace TestKit { struct AsyncSection; }
+namespace TestKit { struct AsyncTest; }
+namespace TestKit { struct AllocationHeader; }
+namespace TestKit { struct AllocationTracker; }
+namespace TestKit { struct Clock; }
+namespace TestKit { struct Event; }
+namespace TestKit { struct EventQueue; }
+namespace TestKit { struct EventReporter; }
+namespace TestKit { struct BenchmarkResult; }
+namespace TestKit { struct BenchmarkRunner; }
+namespace TestKit { enum class Complexity; }
+namespace TestKit { struct FasterThanCheck; }
+namespace TestKit { struct Histogram; }
+namespace TestKit { struct Listener; }
+namespace TestKit { template< typename T > struct Fixture; }
 namespace TestKit { struct Options; }
+namespace TestKit { struct Range; }
+namespace TestKit { struct RegisteredTest; }
+namespace TestKit { struct ResourceUsage; }
 namespace TestKit { struct Node; }
 namespace TestKit { struct Segment; }
+namespace TestKit { struct SectionHistory; }
 namespace TestKit { struct SegmentScopeManager; }
+namespace TestKit { struct StressRunner; }
 namespace TestKit { struct Task; }
+namespace TestKit { struct TimingPause; }
+namespace TestKit { struct UntrackedScope; }
 
 // ----------------------------------------------------------------------------
 // TestKit Outcome Enum
@@ -52,12 +135,83 @@ enum class TestKit::Outcome {
     Passed,
 };
 
+// ----------------------------------------------------------------------------
+// TestKit Complexity Enum
+// ----------------------------------------------------------------------------
+enum class TestKit::Complexity {
+    O_1,
+    O_LOG_N,
+    O_N,
+    O_N_LOG_N,
+    O_N_SQUARED,
+    O_N_CUBED,
+};
+
+// ----------------------------------------------------------------------------
+// TestKit Backpressure Enum
+// ----------------------------------------------------------------------------
+enum class TestKit::Backpressure {
+    Block,          // wait up to 100 ms for the reporter to make room, then spill, the event is dropped when there is no spill file
+    DropPassing,    // drop passing events, failures are handled like Block
+    Spill,          // write the overflow to a spill file that is reported when the reporter stops, dropped when there is no spill file
+};
+
 // ----------------------------------------------------------------------------
 // TestKit Options struct
 // ----------------------------------------------------------------------------
 struct TestKit::Options
 {
     int detailDepth; // How deep in the tree should the reporter continue reporting content in detail? Use -1 to show everything
+
+    std::string sectionFilter = "";     // Only run the sections on this path, such as "Calculator/addition". Empty runs every section
+    int repeat = 1;                     // How many times should TestKit::Run() repeat the tests?
+    bool repeatUntilFail = false;       // Stop repeating as soon as a run fails
+    int repeatThreads = 1;              // Number of threads running repeats in parallel. The tests must be thread safe when above 1
+    uint64_t seed = 0;                  // Seed of the first run, later runs derive their own seeds from it. Use 0 to pick a random seed
+    std::string historyFile = "";       // Append-only file of past section outcomes used to report flaky and slowing sections. Empty disables history
+    bool reportDurations = false;       // Print how long every section took next to its outcome in the report
+    std::chrono::milliseconds benchmarkTime { 100 }; // Minimum time a benchmark (or each combination of a sweep) is measured for
+    double significance = 0.05;         // Largest p-value at which a compared benchmark counts as significantly slower
+    bool detectNoise = true;            // Inspect cpu governors, turbo, load and affinity before benchmarks and warn about noisy machines
+    bool refuseNoisyBaselines = false;  // Make SaveBaseline() refuse to write when any benchmark ran on a noisy machine
+    std::vector< int > cores = {};      // Cores that benchmark and stress threads are pinned to, thread i gets cores[i % size]. Empty leaves threads unpinned
+    bool resourceUsage = false;         // Report page faults, context switches and the rss high-water mark of every section (linux only)
+    int allocationBacktraceDepth = 0;   // Frames of backtrace kept for sampled allocations when TESTKIT_TRACK_ALLOCATIONS is defined, 0 keeps none
+    int allocationSampleRate = 64;      // One in this many tracked allocations keeps a backtrace
+    uint64_t peakMemoryBudget = 0;      // Bytes of heap every section may hold at its peak when TESTKIT_TRACK_ALLOCATIONS is defined, 0 for no limit
+    std::string progressSocket = "";    // Unix domain socket or named pipe that live section and check events are published to (linux only). Empty disables publishing
+    std::string eventLog = "";          // File that a readable line per section and check is streamed to while the tests run, "-" for stdout. Empty disables the log
+    Backpressure backpressure = Backpressure::DropPassing; // What test threads do when live events come faster than they are reported
+    std::string spillFile = "testkit.spill";    // Where events overflow to with Backpressure::Spill
+    int testThreads = 0;                // Number of threads running registered tests in parallel. Use 0 for one per hardware thread
+};
+
+// ----------------------------------------------------------------------------
+// TestKit Clock struct
+// ----------------------------------------------------------------------------
+// A steady clock reading the invariant time stamp counter, which costs a fraction of steady_clock::now(). The tick rate is
+// calibrated once against steady_clock. Without an invariant counter the clock falls back to steady_clock
+struct TestKit::Clock
+{
+    using rep = int64_t;
+    using period = std::nano;
+    using duration = std::chrono::nanoseconds;
+    using time_point = std::chrono::time_point< Clock >;
+    static constexpr bool is_steady = true;
+
+    static time_point now() noexcept;   // the current time, std::chrono compatible
+    static bool UsesTsc();              // is the time stamp counter backing this clock?
+    static duration ThreadCpuTime();    // cpu time consumed by the calling thread so far, process wide where threads can't be told apart
+
+private:
+    struct Calibration
+    {
+        bool tsc = false;           // is the counter invariant and usable?
+        uint64_t base = 0;          // counter value at calibration, keeps the converted values small and precise
+        double nsPerTick = 1.0;     // nanoseconds per counter tick
+    };
+
+    static const Calibration& Calibrated(); // detects and calibrates the counter on first use
 };
 
 // ----------------------------------------------------------------------------
@@ -67,6 +221,98 @@ namespace TestKit::ReportGenerator
 {
     std::string Stringify( const Segment* segment, int depth );
     std::string Stringify( const Task* task, int depth );
+    std::string FormatDuration( std::chrono::duration< double, std::nano > duration ); // human readable duration such as "812.40 ms"
+    std::string FormatRate( double perSecond );                      // human readable rate such as "81.30 M/s"
+    std::string FormatByteRate( double bytesPerSecond );             // human readable rate such as "412.50 MB/s"
+    std::string FormatBytes( uint64_t bytes );                       // human readable size in powers of 1024 such as "32 KB" or "1.5 MB"
+    std::string StringifyHistory( const std::vector< SectionHistory >& history );
+    std::string StringifyBenchmark( const BenchmarkResult& result );                 // one line summary such as "12.34 ns per iteration, 81.03 M/s"
+};
+
+// ----------------------------------------------------------------------------
+// TestKit Range struct
+// ----------------------------------------------------------------------------
+struct TestKit::Range
+{
+    static Range Pow2( int64_t low, int64_t high );                       // low, 2 * low, 4 * low, ... up to high
+    static Range Linear( int64_t low, int64_t high, int64_t step = 1 );   // low, low + step, ... up to high
+    static Range Values( std::initializer_list< int64_t > values );       // exactly the given values
+
+    Range Name( std::string name ) const;   // a copy of this range with a title for the report table
+
+    std::string m_name;                 // the title of this argument in the report table
+    std::vector< int64_t > m_values;    // the argument values to sweep through
+};
+
+// ----------------------------------------------------------------------------
+// TestKit Histogram struct
+// ----------------------------------------------------------------------------
+// A log-linear (HDR style) histogram: every power of two is split into 64 linear sub-buckets, bounding the error to under 1.6%
+struct TestKit::Histogram
+{
+    void Record( uint64_t value );                  // count one value
+    uint64_t Percentile( double percentile ) const; // the value below which the given percentage (0 to 100) of the recorded values fall
+    uint64_t Count() const { return m_count; }      // number of recorded values
+    uint64_t Max() const { return m_max; }          // the largest recorded value, exact
+    void Clear();                                   // forget every recorded value
+    void Merge( const Histogram& other );           // count every value the other histogram recorded
+
+private:
+    static constexpr int SubBucketBits = 7; // 128 direct buckets, then 64 sub-buckets per power of two
+
+    std::vector< uint64_t > m_counts;   // count per bucket, grown on demand up to the highest bucket used
+    uint64_t m_count = 0;               // number of recorded values
+    uint64_t m_max = 0;                 // the largest recorded value
+};
+
+// ----------------------------------------------------------------------------
+// TestKit Benchmark Result struct
+// ----------------------------------------------------------------------------
+struct TestKit::BenchmarkResult
+{
+    std::vector< int64_t > args;        // the arguments of this combination of a sweep
+    uint64_t iterations = 0;            // number of times the body ran while being measured
+    std::chrono::nanoseconds elapsed;   // total measured time
+    std::chrono::nanoseconds cpu {};    // cpu time the measuring threads consumed during the measured time
+    int threads = 1;                    // number of threads running the body concurrently
+    uint64_t itemsPerIteration = 0;     // items processed by one iteration, as declared by the body
+    uint64_t bytesPerIteration = 0;     // bytes processed by one iteration, as declared by the body
+    std::optional< Histogram > latency; // nanoseconds taken by each iteration, only for latency benchmarks
+
+    double NanosecondsPerIteration() const { return iterations > 0 ? (double) elapsed.count() / iterations : 0.0; }
+    double CpuNanosecondsPerIteration() const { return iterations > 0 ? (double) cpu.count() / iterations : 0.0; }
+    double IterationsPerSecond() const { return elapsed.count() > 0 ? iterations * 1e9 / elapsed.count() : 0.0; }
+    double ItemsPerSecond() const { return IterationsPerSecond() * itemsPerIteration; }
+    double BytesPerSecond() const { return IterationsPerSecond() * bytesPerIteration; }
+
+    void Merge( const BenchmarkResult& other ); // fold in another measurement of the same benchmark, such as one from a repeated run
+};
+
+// ----------------------------------------------------------------------------
+// TestKit Measure functions
+// ----------------------------------------------------------------------------
+namespace TestKit::Measure
+{
+    // Median time of a single call to the block. Calls are batched so every sample lasts long enough to be timed accurately
+    std::chrono::nanoseconds Median( const std::function< void() >& block, int samples = 15 );
+};
+
+// ----------------------------------------------------------------------------
+// TestKit Resource Usage struct
+// ----------------------------------------------------------------------------
+struct TestKit::ResourceUsage
+{
+    static ResourceUsage Sample();  // the counters of the calling thread so far, and the current rss high-water mark of the process
+
+    uint64_t minorFaults = 0;           // page faults served without any I/O
+    uint64_t majorFaults = 0;           // page faults that had to read from disk
+    uint64_t voluntarySwitches = 0;     // context switches because the thread blocked, such as waiting on a lock or I/O
+    uint64_t involuntarySwitches = 0;   // context switches because the scheduler preempted the thread
+    uint64_t peakRss = 0;               // rss high-water mark of the process in bytes
+    uint64_t peakRssGrowth = 0;         // how far the rss high-water mark rose, only meaningful for deltas
+
+    ResourceUsage Since( const ResourceUsage& start ) const;    // the counters accumulated since the start sample
+    void Accumulate( const ResourceUsage& other );              // add the counters of another delta, keeping the highest peak
 };
 
 // ----------------------------------------------------------------------------
@@ -86,13 +332,20 @@ struct TestKit::Task : public TestKit::Node
     static Task Build( std::string name, std::source_location source, bool result );    // A task with a given with a result available
 
     friend std::string ReportGenerator::Stringify( const Task*, int );
+    friend struct Segment;
 
     Outcome Check() const override;
 
 private:
+    bool Matches( const Task& other ) const;    // is the other task the same check made from the same point in the codebase?
+    void Merge( const Task& other );            // fold the results of another run of the same check into this task
+
     std::string m_name;                 // a title given to this test 
     std::source_location m_source;      // the point in the codebase where this test was executed
     Outcome m_outcome = Outcome::None;  // the outcome of running this task
+    uint64_t m_runs = 1;                // number of times this check was recorded (more than one when aggregated)
+    uint64_t m_passes = 0;              // number of recorded runs that passed
+    uint64_t m_failures = 0;            // number of recorded runs that failed
 };
 
 // ----------------------------------------------------------------------------
@@ -102,24 +355,199 @@ struct TestKit::Segment : public TestKit::Node
 {
     // Build a new task with the given name
     static Segment Build( std::string name );
+    static Segment BuildAggregate( std::string name ); // repeated checks and same named sub-segments fold into a single node
 
     friend void Reset();
+    friend void RecordHistory();
+    friend bool SaveBaseline( std::string path );
+    friend bool ExportBenchmarkJson( std::string path );
     friend std::string ReportGenerator::Stringify( const Segment*, int );
+    friend struct BenchmarkRunner;
 
     Segment* AddSegment( Segment segment ); // Add the given segment as a sub-segment to this segment
     Task* AddTask( Task task );             // Add the given task under this segment
+    void AddNote( std::string note );       // Attach an informational line (statistics, warnings) to this segment
+    void Merge( const Segment& other );     // Fold the nodes of another segment into this one
+    void AddDuration( std::chrono::nanoseconds duration ) { m_duration += duration; } // Account time spent running this segment
+    void AddUsage( const ResourceUsage& usage );    // Account the resources used while running this segment
     void MarkFailed() { m_didFail = true; } // Mark this segment as failed blocking future tasks from running
+    void MarkBlocked( std::string prerequisite, std::source_location source ); // Mark this segment as not run because the named prerequisite did not pass
     
     bool DidFail() const { return m_didFail; }  // Has this segment have a required task fail yet?
 
     Outcome Check() const override;
     
 private:
+    Task* InsertTask( Task task );          // Add the given task without announcing it, used when merging tasks already reported
+
     std::string m_name;                 // the title given to the task
     std::list< Segment > m_segments;  // a list of segments under this segment
     std::list< Task > m_tasks;        // a list of subtasks directly under this segment
     std::vector< Node* > m_nodes;       // ordered list of tasks and segments
+    std::vector< std::string > m_notes; // informational lines reported under the segment title
+    std::chrono::nanoseconds m_duration { 0 }; // time spent inside this segment, summed over re-entries
+    std::optional< ResourceUsage > m_usage;         // faults, context switches and rss growth inside this segment, when the options ask for them
+    std::optional< BenchmarkResult > m_benchmark;   // the measurement when this segment is a benchmark
+    std::vector< std::string > m_sweep;             // argument titles when the sub-segments are the combinations of a benchmark sweep
+    std::string m_blockedBy;            // the prerequisite that kept this segment from running, empty when nothing did
     bool m_didFail = false;             // is this segment in a failed state?
+    bool m_aggregate = false;           // do repeated checks and segments fold together instead of being appended?
+};
+
+// ----------------------------------------------------------------------------
+// TestKit Untracked Scope struct
+// ----------------------------------------------------------------------------
+// Allocations the framework makes for its own bookkeeping (the report tree, fixtures) outlive the section they are made in
+// and must not count as leaks. Does nothing unless TESTKIT_TRACK_ALLOCATIONS is defined
+struct TestKit::UntrackedScope
+{
+    UntrackedScope();   // stop tracking the allocations of this thread
+    ~UntrackedScope();  // track them again, unless an outer scope is still open
+    UntrackedScope( const UntrackedScope& ) = delete;
+};
+
+#if defined( TESTKIT_TRACK_ALLOCATIONS )
+// ----------------------------------------------------------------------------
+// TestKit Allocation Header struct
+// ----------------------------------------------------------------------------
+// Placed right in front of every allocation handed out by the replaced operator new
+struct alignas( 16 ) TestKit::AllocationHeader
+{
+    AllocationHeader* m_prev = nullptr;     // the neighbours in the live list of the owning tracker
+    AllocationHeader* m_next = nullptr;
+    std::atomic< AllocationTracker* > m_tracker = nullptr; // the tracker this allocation is live in, null when untracked
+    size_t m_size = 0;                      // bytes requested by the caller
+    void* m_raw = nullptr;                  // the block returned by malloc, the header and the padding for alignment included
+    void** m_frames = nullptr;              // the sampled backtrace, null when none was taken
+    int m_depth = 0;                        // number of frames in the sampled backtrace
+};
+
+// ----------------------------------------------------------------------------
+// TestKit Allocation Tracker struct
+// ----------------------------------------------------------------------------
+// Every allocation made while a section runs is linked into the tracker of that section until it is freed. A nested section hands
+// whatever is still live to the enclosing section when it exits. When the outermost section exits having allocated more than it
+// freed, whatever is still live is reported as leaked
+struct TestKit::AllocationTracker
+{
+    void Enter();                                               // track the allocations of the calling thread into this tracker
+    void Exit( Segment* segment, std::source_location source, uint64_t budget ); // stop tracking, report leaks and the peak against the budget (0 uses the options)
+
+    void Link( AllocationHeader* header );      // add a live allocation, the caller holds the allocation mutex
+    void Unlink( AllocationHeader* header );    // remove a freed allocation, the caller holds the allocation mutex
+
+    AllocationTracker* m_parent = nullptr;  // the tracker of the enclosing section on this thread
+    AllocationHeader* m_live = nullptr;     // allocations made under this tracker that are still live
+    uint64_t m_liveBytes = 0;               // bytes of the live allocations
+    uint64_t m_liveCount = 0;               // number of live allocations
+    int64_t m_balance = 0;                  // bytes allocated minus bytes freed by this thread while the tracker was active
+    int64_t m_peak = 0;                     // the highest balance reached, nested sections included
+};
+#endif
+
+// ----------------------------------------------------------------------------
+// TestKit Event struct
+// ----------------------------------------------------------------------------
+// A fixed size record of something that happened while the tests ran, small enough to be copied through a lock-free queue
+struct TestKit::Event
+{
+    enum class Type : uint8_t
+    {
+        SectionEnter,   // a section started, the name is its "/" separated path
+        SectionExit,    // a section finished with the given outcome, the name is its path
+        Task,           // a check was recorded with the given outcome, the name is the title of the check
+    };
+
+    static Event Make( Type type, Outcome outcome, std::string_view name ); // an event stamped with the current time and thread, the name is truncated to fit
+
+    Type type;          // what happened
+    uint8_t outcome;    // the TestKit::Outcome of the section or check, None when there is none yet
+    uint16_t length;    // bytes used in the name
+    uint32_t thread;    // small id of the thread the event happened on, in order of first event
+    int64_t time;       // nanoseconds since the publisher was started
+    char name[112];     // the section path or check title, not null terminated
+};
+
+// ----------------------------------------------------------------------------
+// TestKit Event Queue struct
+// ----------------------------------------------------------------------------
+// A bounded lock-free queue for many producers and one consumer. Every cell carries a sequence number telling whether it
+// is free to be written for a given lap around the ring or holds an event ready to be read
+struct TestKit::EventQueue
+{
+    EventQueue( size_t capacity );  // the capacity is rounded up to a power of two
+
+    bool Push( const Event& event );    // false when the queue is full, never blocks
+    bool Pop( Event& event );           // false when the queue is empty, only one thread may pop
+
+private:
+    struct Cell
+    {
+        std::atomic< uint64_t > sequence;   // the position this cell can be written for, or that position + 1 once it holds an event
+        Event event;                        // the queued event
+    };
+
+    std::unique_ptr< Cell[] > m_cells;              // the ring of cells
+    uint64_t m_mask;                                // capacity - 1, maps a position to its cell
+    alignas( 64 ) std::atomic< uint64_t > m_tail;   // the next position producers write to
+    alignas( 64 ) uint64_t m_head = 0;              // the next position the consumer reads from
+};
+
+// ----------------------------------------------------------------------------
+// TestKit Event Reporter struct
+// ----------------------------------------------------------------------------
+// Drains the event queue on a background thread into the configured sinks, so formatting and I/O never run on a test thread.
+// Messages on the progress socket are a native endian u32 payload length followed by the payload:
+//   u8 type | u8 outcome | u32 thread | i64 time (ns) | u16 name length | name
+struct TestKit::EventReporter
+{
+    ~EventReporter();   // reports what is still queued and joins the reporter thread
+
+    void Start( const Options& options );   // start reporting to the sinks in the options, stops any earlier reporting. Without sinks it only stops
+    void Stop();                            // report what is still queued or spilled and join the reporter thread
+
+    bool Enabled() const { return m_enabled.load( std::memory_order_relaxed ); } // are events being reported? lets callers skip building them
+    void Publish( const Event& event );     // queue an event, what happens when the queue is full depends on Options::backpressure
+
+private:
+    void Report();                          // the reporter thread, drains the queue until stopped
+    void Deliver( const Event& event );     // hand one event to every sink
+    bool Spill( const Event& event );       // write an event that found no room to the spill file, false when there is none to write to
+    int Connect() const;                    // a descriptor for the progress socket or pipe, -1 when nobody listens yet
+
+    EventQueue m_queue { 4096 };            // the events waiting to be reported
+    std::atomic< Backpressure > m_backpressure = Backpressure::DropPassing; // what publishing threads do when the queue is full
+    std::string m_socketPath;               // the socket or pipe events are written to, empty for none
+    std::string m_logPath;                  // the file the readable event log is streamed to, "-" for stdout, empty for none
+    std::string m_spillPath;                // the file events overflow into under the spill policy
+    std::thread m_reporter;                 // the background thread reporting events
+    std::atomic< bool > m_enabled = false;  // are events being queued?
+    std::atomic< bool > m_stop = false;     // should the reporter finish after draining the queue?
+    std::atomic< uint64_t > m_dropped = 0;  // events lost because the queue was full
+    std::atomic< bool > m_stalled = false;  // did waiting for room time out? publishers stop waiting until an event fits again
+
+    std::mutex m_spillMutex;                // serializes the threads spilling into the spill file
+    std::FILE* m_spill = nullptr;           // the open spill file, null until the first event spilled
+    bool m_spillClosed = false;             // has the reporter replayed the spill file? nothing spills after that
+    std::FILE* m_log = nullptr;             // the open event log, owned by the reporter thread
+    int m_socket = -1;                      // the connected progress socket or pipe, owned by the reporter thread
+    Clock::time_point m_lastAttempt;        // when the reporter last tried to reach the progress listener
+};
+
+// ----------------------------------------------------------------------------
+// TestKit Listener struct
+// ----------------------------------------------------------------------------
+// Instrumentation hooks for profilers, tracers and metrics exporters. Callbacks run synchronously on the thread that caused them,
+// possibly on several threads at once, and must not record checks themselves. Override only what is needed
+struct TestKit::Listener
+{
+    virtual ~Listener() = default;
+
+    virtual void OnRunStart( uint64_t /* run */, uint64_t /* seed */ ) {}                   // TestKit::Run() is about to run the tests once
+    virtual void OnRunEnd( uint64_t /* run */, Outcome /* outcome */ ) {}                   // a run finished with the given outcome
+    virtual void OnSectionEnter( const std::string& /* path */ ) {}                         // a section with the given "/" separated path started
+    virtual void OnSectionExit( const std::string& /* path */, Outcome /* outcome */, std::chrono::nanoseconds /* duration */ ) {} // the section finished
+    virtual void OnTask( const std::string& /* name */, Outcome /* outcome */, std::source_location /* source */ ) {} // a check was recorded
 };
 
 // ----------------------------------------------------------------------------
@@ -127,10 +555,306 @@ private:
 // ----------------------------------------------------------------------------
 struct TestKit::SegmentScopeManager
 {
-    SegmentScopeManager( std::string name ); // pushes a new segment to the working stack
+    SegmentScopeManager( std::string name, std::source_location source = std::source_location::current() ); // pushes a new segment to the working stack
+    SegmentScopeManager( std::string name, uint64_t peakBudget, std::source_location source = std::source_location::current() ); // fails when the heap held at the peak exceeds the budget
     ~SegmentScopeManager();                  // pops the last added segment from the working stack
 
     explicit operator bool();
+
+private:
+    size_t m_pathLength;    // length of the section path before this section was entered
+    bool m_enabled;         // does this section match the section filter?
+    Segment* m_segment = nullptr;                       // the segment this scope records into
+    Clock::time_point m_start;                          // when the section was entered
+    std::optional< ResourceUsage > m_usage;             // the resource counters when the section was entered
+    std::source_location m_source;                      // the point in the codebase where the section was declared
+    uint64_t m_budget = 0;                              // bytes of heap the section may hold at its peak, 0 defers to the options
+#if defined( TESTKIT_TRACK_ALLOCATIONS )
+    AllocationTracker m_tracker;                        // the allocations made while the section runs
+#endif
+};
+
+// ----------------------------------------------------------------------------
+// TestKit Async Section struct
+// ----------------------------------------------------------------------------
+// A section for coroutines. It lives in the coroutine frame and records into the segment it captured when it was entered,
+// instead of the top of the segment stack of whichever thread the coroutine happens to resume on
+struct TestKit::AsyncSection
+{
+    AsyncSection();     // the outermost scope, new sections are added under the top of the segment stack of the calling thread
+    AsyncSection( std::string name, const AsyncSection& parent ); // enters the section under the one the parent captured
+    ~AsyncSection();    // accounts the time between entering and leaving the section, suspensions included
+    AsyncSection( const AsyncSection& ) = delete;
+
+    bool DidFail() const;                               // has a required check in this section failed yet?
+    void Record( Task task, bool required ) const;      // add the task to the captured segment, a failed required task blocks the rest
+
+    explicit operator bool() const { return m_enabled; }
+
+private:
+    Segment* m_segment = nullptr;   // the segment this section records into, null for the outermost scope
+    std::string m_path;             // the "/" separated names of the sections leading to this one
+    bool m_enabled = true;          // does this section match the section filter?
+    Clock::time_point m_start;      // when the section was entered
+};
+
+// ----------------------------------------------------------------------------
+// TestKit Async Test struct
+// ----------------------------------------------------------------------------
+// The coroutine type of an async test. It starts suspended, RUN_ASYNC drives it. Awaiting another async test runs it
+// to completion before the caller continues, rethrowing what it threw
+struct TestKit::AsyncTest
+{
+    struct promise_type
+    {
+        struct FinalAwaiter
+        {
+            bool await_ready() noexcept { return false; }
+            std::coroutine_handle<> await_suspend( std::coroutine_handle< promise_type > handle ) noexcept; // continue the awaiting test, if any
+            void await_resume() noexcept {}
+        };
+
+        AsyncTest get_return_object() { return AsyncTest( std::coroutine_handle< promise_type >::from_promise( *this ) ); }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        FinalAwaiter final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { m_exception = std::current_exception(); }
+
+        std::coroutine_handle<> m_continuation;     // the test awaiting this one, null for a test run by RUN_ASYNC
+        std::exception_ptr m_exception;             // what the test threw, if anything
+    };
+
+    explicit AsyncTest( std::coroutine_handle< promise_type > handle ) : m_handle( handle ) {}
+    AsyncTest( AsyncTest&& other ) noexcept : m_handle( std::exchange( other.m_handle, nullptr ) ) {}
+    AsyncTest( const AsyncTest& ) = delete;
+    ~AsyncTest();                                   // destroys the coroutine frame, suspended or not
+
+    bool await_ready() const noexcept { return false; }
+    std::coroutine_handle<> await_suspend( std::coroutine_handle<> caller ) noexcept; // start the awaited test on the same turn of the loop
+    void await_resume();
+
+private:
+    friend struct AsyncExecutor;
+    std::coroutine_handle< promise_type > m_handle;
+};
+
+// ----------------------------------------------------------------------------
+// TestKit Registered Test struct
+// ----------------------------------------------------------------------------
+// A test run by RunRegistered once the tests it depends on have finished
+struct TestKit::RegisteredTest
+{
+    std::string name;                           // the title of the test, also how other tests refer to it
+    std::vector< std::string > dependencies;    // names of the tests that must finish without failing before this one runs
+    std::function< void() > test;               // the test itself
+    std::source_location source;                // the point in the codebase where the test was registered
+};
+
+// ----------------------------------------------------------------------------
+// TestKit Async Event struct
+// ----------------------------------------------------------------------------
+// What an async test can wait for on the executor, built by Readable, Writable, Sleep and Yield
+struct TestKit::AsyncEvent
+{
+    enum class Type
+    {
+        Yield,      // resume on the next turn of the loop
+        Sleep,      // resume once the deadline passed
+        Readable,   // resume once the descriptor can be read without blocking
+        Writable,   // resume once the descriptor can be written without blocking
+    };
+
+    bool await_ready() const noexcept { return false; }
+    void await_suspend( std::coroutine_handle<> handle ) const; // hand the coroutine to the executor running on this thread
+    void await_resume() const noexcept {}
+
+    Type type;                      // what to wait for
+    int descriptor = -1;            // the descriptor to wait on when readable or writable
+    Clock::time_point deadline {};  // when to resume a sleep
+};
+
+// ----------------------------------------------------------------------------
+// TestKit Async Executor struct
+// ----------------------------------------------------------------------------
+// A single threaded event loop that runs async tests concurrently. Descriptors are waited on with epoll (linux only,
+// elsewhere they are taken as ready). While a test runs, its segment is on top of the segment stack
+struct TestKit::AsyncExecutor
+{
+    AsyncExecutor();
+    ~AsyncExecutor();
+    AsyncExecutor( const AsyncExecutor& ) = delete;
+
+    // Run the tests to completion, each in a segment of its own under the current section
+    void Run( std::vector< AsyncTest >& tests, const std::vector< std::string >& names, std::source_location source );
+
+    void Schedule( std::coroutine_handle<> handle );                                // resume on the next turn of the loop
+    void ScheduleAt( Clock::time_point deadline, std::coroutine_handle<> handle );  // resume once the deadline passed
+    void ScheduleOn( int descriptor, bool write, std::coroutine_handle<> handle );  // resume once the descriptor is ready
+
+private:
+    struct Waiter
+    {
+        std::coroutine_handle<> handle;     // the coroutine to resume
+        size_t test = 0;                    // index of the test the coroutine belongs to
+    };
+
+    struct Descriptor
+    {
+        std::optional< Waiter > reader;     // waiting for the descriptor to be readable
+        std::optional< Waiter > writer;     // waiting for the descriptor to be writable
+    };
+
+    void Arm( int descriptor );             // (re)register the interest of the waiters on the descriptor with epoll
+    void Poll( int timeout );               // wait up to timeout milliseconds (-1 for ever) for descriptors to become ready
+    void Resume( Waiter waiter );           // resume the coroutine with the segment of its test on top of the stack
+
+    int m_epoll = -1;                                   // the epoll instance, -1 when unavailable
+    std::deque< Waiter > m_ready;                       // coroutines to resume on the next turn of the loop
+    std::multimap< Clock::time_point, Waiter > m_timers;// sleeping coroutines by deadline
+    std::map< int, Descriptor > m_descriptors;          // coroutines waiting on a descriptor
+    std::vector< Segment* > m_segments;                 // the segment of every test, null when the section filter left it out
+    std::vector< std::string > m_paths;                 // the section path of every test
+    size_t m_current = 0;                               // index of the test running right now
+};
+
+// ----------------------------------------------------------------------------
+// TestKit Section History struct
+// ----------------------------------------------------------------------------
+struct TestKit::SectionHistory
+{
+    static constexpr uint16_t MaxPathLength = 4096; // longer section paths are cut short in the history file
+
+    std::string path;                   // the "/" separated section names
+    uint64_t runs = 0;                  // number of recorded runs that passed or failed
+    uint64_t failures = 0;              // number of recorded runs that failed
+    uint64_t flips = 0;                 // number of times the outcome changed between consecutive runs
+    std::vector< int64_t > durations;   // nanoseconds spent in the section per run, oldest first
+
+    double FlakeRate() const;   // how often the outcome flips between consecutive runs (0 to 1)
+    double Trend() const;       // relative change of the recent durations against the older ones, 0.25 is 25% slower
+};
+
+// ----------------------------------------------------------------------------
+// TestKit Faster Than Check struct
+// ----------------------------------------------------------------------------
+struct TestKit::FasterThanCheck
+{
+    FasterThanCheck( std::chrono::duration< double, std::nano > budget, std::source_location source = std::source_location::current() );
+
+    void operator=( std::function< void() > block ); // times the block and records whether its median fits the budget
+
+private:
+    std::chrono::nanoseconds m_budget;  // the maximum median time allowed for one run of the block
+    std::source_location m_source;      // the point in the codebase where the check was made
+};
+
+// ----------------------------------------------------------------------------
+// TestKit Benchmark Runner struct
+// ----------------------------------------------------------------------------
+struct TestKit::BenchmarkRunner
+{
+    template< typename... Ranges >
+    BenchmarkRunner( std::string name, Ranges... ranges ) : m_name( name ), m_ranges{ ranges... } {}
+
+    void operator=( std::function< void() > body ); // measures the body once per combination of the argument ranges
+    BenchmarkRunner& Latency() { m_latency = true; return *this; } // time every iteration on its own into a latency histogram
+    BenchmarkRunner& Threads( int maxThreads ) { m_maxThreads = maxThreads; return *this; } // run the body on 1, 2, 4, ... up to maxThreads threads
+    BenchmarkRunner& Memory( uint64_t maxBytes ) { m_maxBytes = maxBytes; return *this; }   // run the body over working sets from 4 KB up to maxBytes
+
+private:
+    BenchmarkResult Measure( const std::function< void() >& body, std::vector< int64_t > args ); // run the body until the benchmark time is reached
+    void MeasureScaling( Segment* segment, const std::function< void() >& body );                // one child segment per thread count with the scaling curve
+    void MeasureMemory( Segment* segment, const std::function< void() >& body );                 // one child segment per working set size and access pattern
+
+    std::string m_name;             // the title given to the benchmark segment
+    std::vector< Range > m_ranges;  // the argument ranges whose cartesian product is swept
+    bool m_latency = false;         // is every iteration timed individually?
+    int m_maxThreads = 0;           // the largest thread count of a scaling benchmark, 0 for a single threaded benchmark
+    uint64_t m_maxBytes = 0;        // the largest working set of a memory benchmark, 0 when not sweeping working sets
+};
+
+// ----------------------------------------------------------------------------
+// TestKit Affinity Guard struct
+// ----------------------------------------------------------------------------
+struct TestKit::AffinityGuard
+{
+    AffinityGuard( int slot );  // pins the calling thread to Options::cores[slot % size], does nothing when no cores are configured
+    ~AffinityGuard();           // restores the affinity the thread had before
+    AffinityGuard( const AffinityGuard& ) = delete;
+
+private:
+#if defined( __linux__ )
+    cpu_set_t m_previous;       // the affinity to restore
+#endif
+    bool m_pinned = false;      // was the thread actually pinned?
+};
+
+// ----------------------------------------------------------------------------
+// TestKit Timing Pause struct
+// ----------------------------------------------------------------------------
+struct TestKit::TimingPause
+{
+    TimingPause();  // pauses the benchmark timing of the calling thread
+    ~TimingPause(); // resumes the benchmark timing of the calling thread
+    TimingPause( const TimingPause& ) = delete;
+
+    explicit operator bool() const { return true; }
+};
+
+// ----------------------------------------------------------------------------
+// TestKit Stress Runner struct
+// ----------------------------------------------------------------------------
+struct TestKit::StressRunner
+{
+    StressRunner( std::string name, int threads, uint64_t iterations, std::source_location source = std::source_location::current() );
+
+    void operator=( std::function< void() > body ); // releases every thread together and runs the body repeatedly on each of them
+
+private:
+    std::string m_name;             // the title given to the stress segment
+    int m_threads;                  // number of threads hammering the body concurrently
+    uint64_t m_iterations;          // number of times each thread runs the body
+    std::source_location m_source;  // the point in the codebase where the stress test was declared
+};
+
+// ----------------------------------------------------------------------------
+// TestKit Fixture struct
+// ----------------------------------------------------------------------------
+template< typename T >
+struct TestKit::Fixture
+{
+    // A lease on the shared fixture value. Releasing the last registered lease tears the value down
+    struct Handle
+    {
+        Handle( Fixture* fixture, const T* value ) : m_fixture( fixture ), m_value( value ) {}
+        Handle( Handle&& other ) noexcept : m_fixture( std::exchange( other.m_fixture, nullptr ) ), m_value( other.m_value ) {}
+        Handle( const Handle& ) = delete;
+        ~Handle() { if( m_fixture ) { m_fixture->Release(); } }
+
+        const T& operator*() const  { return *m_value; }
+        const T* operator->() const { return m_value; }
+
+    private:
+        Fixture* m_fixture; // the fixture this lease belongs to
+        const T* m_value;   // the shared read-only value
+    };
+
+    Fixture( std::string name, std::function< T() > builder ); // the builder is invoked lazily on the first acquire
+    Fixture( const Fixture& ) = delete;
+
+    Handle Acquire( std::source_location source = std::source_location::current() ); // build the value if needed and lease it
+    void Register( int users = 1 );                                                     // announce users so the value can be torn down once they all finish
+
+private:
+    void Release(); // a lease finished using the value
+
+    std::string m_name;                 // the title used for the synthetic fixture segment
+    std::function< T() > m_builder;     // builds a fresh value
+    std::unique_ptr< T > m_value;       // the built value, null until first use and after teardown
+    std::mutex m_mutex;                 // serializes building, leasing and teardown across threads
+    int m_registered = 0;               // number of users announced through Register()
+    int m_finished = 0;                 // number of leases released so far
+    int m_active = 0;                   // number of leases currently alive
 };
 
 // ----------------------------------------------------------------------------
@@ -139,15 +863,172 @@ struct TestKit::SegmentScopeManager
 namespace TestKit
 {
     Segment __internal_root = Segment::Build( "" );                             // the main root segment hosting all subtasks and children segments
-    std::stack< Segment* > __internal_segment_stack ( { &__internal_root } );   // the stack maintaining how the segments are stacked in scope
+    thread_local std::stack< Segment* > __internal_segment_stack ( { &__internal_root } ); // the stack maintaining how the segments are stacked in scope (per thread)
     
     Options __internal_curr_options = Options{ .detailDepth = -1 };
 
-    void SetNewOptions( Options newOptions ) { __internal_curr_options = newOptions; }
+    std::list< Segment > __internal_fixture_segments;   // synthetic fixture segments waiting to be attached to the root
+    std::mutex __internal_fixture_mutex;                // guards the pending fixture segments, fixtures may be built on any thread
+
+    thread_local std::string __internal_section_path;  // the "/" separated names of the sections entered on this thread
+    bool __internal_section_enabled( const std::string& path ); // is the section with the given path on the filtered path, or an ancestor or descendant of it?
+    std::mutex __internal_async_mutex;                  // guards the segments async sections record into, coroutines may resume on any thread
+    thread_local AsyncExecutor* __internal_executor = nullptr;  // the executor running async tests on this thread
+
+    // Run the async tests concurrently on a single threaded executor, reporting the latency of each
+    void RunAsync( std::vector< AsyncTest > tests, const std::vector< std::string >& names = {}, std::source_location source = std::source_location::current() );
+    template< typename... Tests > std::vector< AsyncTest > __internal_async_tests( Tests... tests );   // gather the arguments of RUN_ASYNC
+    std::vector< AsyncTest > __internal_async_tests( std::vector< AsyncTest > tests ) { return tests; }
+    std::vector< std::string > __internal_split_arguments( std::string_view arguments );               // split the stringized arguments of a macro at the top level commas
+    AsyncEvent Readable( int descriptor );                  // await until the descriptor can be read without blocking
+    AsyncEvent Writable( int descriptor );                  // await until the descriptor can be written without blocking
+    AsyncEvent Sleep( std::chrono::nanoseconds duration );  // await until the duration passed, without blocking other tests
+    AsyncEvent Yield();                                     // let the other tests run before continuing
+
+    std::vector< RegisteredTest > __internal_registered_tests;  // the tests run by RunRegistered, in registration order
+    std::mutex __internal_registry_mutex;                       // guards the registered tests
+
+    // Register a test that runs once every test named in its dependencies finished without failing
+    void RegisterTest( std::string name, std::vector< std::string > dependencies, std::function< void() > test, std::source_location source = std::source_location::current() );
+    void RunRegistered();   // run the registered tests in parallel, in an order that respects their dependencies
+
+    std::vector< Listener* > __internal_listeners;          // the registered listeners, in registration order
+    std::shared_mutex __internal_listener_mutex;            // guards the listeners, callbacks share it while registration is exclusive
+    std::atomic< bool > __internal_has_listeners = false;   // lets every hook skip the listeners with a single load when none are registered
+    void AddListener( Listener* listener );                 // start calling back the listener, the caller keeps ownership
+    void RemoveListener( Listener* listener );              // stop calling back the listener
+    template< typename Callback > void __internal_notify( Callback callback ); // call back every listener, compiled out by TESTKIT_DISABLE_LISTENERS
+
+    EventReporter __internal_reporter;                  // streams live events to the sinks set in the options
+    Clock::time_point __internal_event_epoch;           // the time events are stamped relative to
+    std::atomic< uint32_t > __internal_thread_ids = 0;  // the number of threads that published an event so far
+    thread_local uint64_t __internal_seed = 0;          // the seed of the run currently executing on this thread
+
+    void SetNewOptions( Options newOptions );
+    void Run( std::function< void() > tests, std::source_location source = std::source_location::current() ); // run the tests honoring the repeat options
+    uint64_t Seed() { return __internal_seed; }                                                                 // the seed to feed random generators in the current run
+    uint64_t __internal_derive_seed( uint64_t base, uint64_t stream );                                          // an independent seed for the given run or thread, stream 0 keeps the base
+
+    thread_local std::vector< int64_t > __internal_benchmark_args;  // the arguments of the benchmark combination running on this thread
+    thread_local int __internal_thread_index = 0;                   // index of this thread within a stress test or scaling benchmark
+    int ThreadIndex() { return __internal_thread_index; }           // index of the calling thread within a stress test or scaling benchmark
+    thread_local uint64_t __internal_benchmark_items = 0;           // items processed per iteration by the benchmark running on this thread
+    thread_local uint64_t __internal_benchmark_bytes = 0;           // bytes processed per iteration by the benchmark running on this thread
+    int64_t Arg( size_t index ) { return index < __internal_benchmark_args.size() ? __internal_benchmark_args[index] : 0; } // argument of the running benchmark
+    void SetItemsPerIteration( uint64_t items ) { __internal_benchmark_items = items; }  // declare how many items one iteration of the running benchmark processes
+    void SetBytesPerIteration( uint64_t bytes ) { __internal_benchmark_bytes = bytes; }  // declare how many bytes one iteration of the running benchmark processes
+#if defined( TESTKIT_TRACK_ALLOCATIONS )
+    thread_local AllocationTracker* __internal_allocation_tracker = nullptr;   // the tracker of the innermost section running on this thread
+    thread_local int __internal_untracked = 0;                  // allocations on this thread are not tracked while above 0
+    thread_local uint64_t __internal_allocation_samples = 0;    // tracked allocations made on this thread, drives the backtrace sampling
+    std::mutex __internal_allocation_mutex;                     // guards the live lists of every tracker, allocations may be freed on any thread
+    void* __internal_allocate( size_t size, size_t alignment, void* site ); // the replaced operator new, site is its return address, null when out of memory
+    void __internal_deallocate( void* pointer );                // the replaced operator delete
+#endif
+
+    thread_local bool __internal_timing_paused = false;            // is the benchmark timing of this thread paused?
+    thread_local Clock::time_point __internal_pause_start;          // when the benchmark timing of this thread was paused
+    thread_local Clock::duration __internal_paused_time {};         // total time this thread spent paused during the current measurement
+    thread_local uint64_t __internal_pauses = 0;                    // number of pauses this thread made during the current measurement
+    void PauseTiming();                                             // exclude what follows in the running benchmark iteration from the measurement
+    void ResumeTiming();                                            // include what follows in the measurement again
+    thread_local std::span< uint64_t > __internal_working_set;     // the working set of the memory benchmark running on this thread
+    std::span< uint64_t > WorkingSet() { return __internal_working_set; } // working set of the running memory benchmark, every element holds the index to visit next
+    std::vector< uint64_t > CacheSizes();                           // bytes of the L1 data, L2 and L3 caches, 0 where unknown (linux only)
+    bool SaveBaseline( std::string path );                          // write every benchmark result, including its rates, to a baseline file
+    bool ExportBenchmarkJson( std::string path );                   // write every benchmark result as Google Benchmark compatible json
+
+    // Interleave timed samples of both implementations in random order and fail if b is significantly slower than a
+    void CompareBenchmarks( std::string name, std::function< void() > a, std::function< void() > b, std::source_location source = std::source_location::current() );
+
+    std::atomic< int > __internal_noisy_benchmarks = 0;     // number of benchmarks that ran on a noisy machine since the last reset
+    std::atomic< bool > __internal_pinning_noted = false;   // was an unpinned benchmark pointed out since the last reset?
+    std::vector< std::string > DetectBenchmarkNoise();      // warnings about machine settings that make timings unreliable (linux only)
+    void __internal_warn_noise( Segment* segment );         // attach the noise warnings to a benchmark segment, honoring the options
+    void RecordHistory();                                           // append the outcome and duration of every section to the history file
+    std::vector< SectionHistory > LoadHistory( std::string path );  // read the per-section history from the given file
+
+    // Fit the time fn( n ) takes across the sizes and check that it grows no faster than the expected complexity
+    void CheckComplexity( const std::vector< int64_t >& sizes, std::function< void( int64_t ) > fn, Complexity expected, std::source_location source = std::source_location::current() );
     void Reset();
     std::string GenerateReport();
 }
 
+// the scope CO_SECTION and CO_CHECK fall back to when no coroutine section encloses them
+const TestKit::AsyncSection __testkit_co_section;
+
+// ----------------------------------------------------------------------------
+// TestKit Clock implementation
+// ----------------------------------------------------------------------------
+const TestKit::Clock::Calibration& TestKit::Clock::Calibrated()
+{
+    static const Calibration calibration = []()
+    {
+        Calibration out;
+#if defined( TESTKIT_HAS_TSC )
+        // the counter must tick at a constant rate across frequency changes and sleep states (cpuid 0x80000007, edx bit 8)
+        // and rdtscp must be available (cpuid 0x80000001, edx bit 27)
+        unsigned int regs[4] = {};
+#if defined( _MSC_VER )
+        __cpuid( (int*) regs, 0x80000000 );
+        unsigned int highest = regs[0];
+        if( highest >= 0x80000007 ) { __cpuid( (int*) regs, 0x80000007 ); }
+        bool invariant = highest >= 0x80000007 && ( regs[3] & ( 1u << 8 ) );
+        __cpuid( (int*) regs, 0x80000001 );
+        bool rdtscp = regs[3] & ( 1u << 27 );
+#else
+        unsigned int highest = __get_cpuid_max( 0x80000000, nullptr );
+        bool invariant = highest >= 0x80000007 && __get_cpuid( 0x80000007, &regs[0], &regs[1], &regs[2], &regs[3] ) && ( regs[3] & ( 1u << 8 ) );
+        bool rdtscp = highest >= 0x80000001 && __get_cpuid( 0x80000001, &regs[0], &regs[1], &regs[2], &regs[3] ) && ( regs[3] & ( 1u << 27 ) );
+#endif
+        if( !invariant || !rdtscp ) { return out; }
+
+        // measure the tick rate over a short spin against steady_clock
+        unsigned int aux;
+        auto start = std::chrono::steady_clock::now();
+        uint64_t first = __rdtscp( &aux );
+        while( std::chrono::steady_clock::now() - start < std::chrono::milliseconds( 10 ) ) {}
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        uint64_t last = __rdtscp( &aux );
+        if( last <= first ) { return out; }
+
+        out.tsc = true;
+        out.base = first;
+        out.nsPerTick = (double) std::chrono::duration_cast< std::chrono::nanoseconds >( elapsed ).count() / ( last - first );
+#endif
+        return out;
+    }();
+    return calibration;
+}
+
+TestKit::Clock::time_point TestKit::Clock::now() noexcept
+{
+#if defined( TESTKIT_HAS_TSC )
+    const Calibration& calibration = Calibrated();
+    if( calibration.tsc )
+    {
+        unsigned int aux;
+        uint64_t ticks = __rdtscp( &aux );
+        return time_point( duration( (rep) ( (double) (int64_t) ( ticks - calibration.base ) * calibration.nsPerTick ) ) );
+    }
+#endif
+    return time_point( std::chrono::duration_cast< duration >( std::chrono::steady_clock::now().time_since_epoch() ) );
+}
+
+bool TestKit::Clock::UsesTsc()
+{
+    return Calibrated().tsc;
+}
+
+TestKit::Clock::duration TestKit::Clock::ThreadCpuTime()
+{
+#if defined( CLOCK_THREAD_CPUTIME_ID )
+    timespec now;
+    if( clock_gettime( CLOCK_THREAD_CPUTIME_ID, &now ) == 0 ) { return std::chrono::seconds( now.tv_sec ) + std::chrono::nanoseconds( now.tv_nsec ); }
+#endif
+    return std::chrono::duration_cast< duration >( std::chrono::duration< double >( (double) std::clock() / CLOCKS_PER_SEC ) );
+}
+
 // ----------------------------------------------------------------------------
 // TestKit Report Generator implementation
 // ----------------------------------------------------------------------------
@@ -174,6 +1055,14 @@ std::string TestKit::ReportGenerator::Stringify( const TestKit::Task* task, int
     }
 
     out += " " + task->m_name;
+    if( task->m_runs > 1 && outcome == Outcome::Passed )
+    {
+        out += std::format( " (×{})", task->m_runs );
+    }
+    else if( task->m_runs > 1 && outcome == Outcome::Failed )
+    {
+        out += std::format( " (failed {} of {} runs, {:.3g}%)", task->m_failures, task->m_runs, 100.0 * task->m_failures / task->m_runs );
+    }
     if( outcome == Outcome::Failed )
     {
         out += std::format( " ( at file: {}, line: {} )", task->m_source.file_name(), task->m_source.line() );
@@ -182,7 +1071,95 @@ std::string TestKit::ReportGenerator::Stringify( const TestKit::Task* task, int
     return out;
 }
 
-std::string TestKit::ReportGenerator::Stringify( const TestKit::Segment* segment, int depth )
+std::string TestKit::ReportGenerator::FormatDuration( std::chrono::duration< double, std::nano > duration )
+{
+    double ns = duration.count();
+    if( ns < 1e3 ) { return std::format( "{:.2f} ns", ns ); }
+    if( ns < 1e6 ) { return std::format( "{:.2f} µs", ns / 1e3 ); }
+    if( ns < 1e9 ) { return std::format( "{:.2f} ms", ns / 1e6 ); }
+    return std::format( "{:.2f} s", ns / 1e9 );
+}
+
+std::string TestKit::ReportGenerator::FormatRate( double perSecond )
+{
+    if( perSecond < 1e3 ) { return std::format( "{:.2f}/s", perSecond ); }
+    if( perSecond < 1e6 ) { return std::format( "{:.2f} k/s", perSecond / 1e3 ); }
+    if( perSecond < 1e9 ) { return std::format( "{:.2f} M/s", perSecond / 1e6 ); }
+    return std::format( "{:.2f} G/s", perSecond / 1e9 );
+}
+
+std::string TestKit::ReportGenerator::StringifyHistory( const std::vector< SectionHistory >& history )
+{
+    // the sections that are both slow and flaky come first, they are the best candidates to fix or quarantine
+    std::vector< const SectionHistory* > noteworthy;
+    for( const SectionHistory& section : history )
+    {
+        if( section.flips > 0 || section.Trend() > 0.1 ) { noteworthy.push_back( &section ); }
+    }
+    if( noteworthy.empty() ) { return ""; }
+
+    auto mean = []( const SectionHistory* section )
+    {
+        double total = 0.0;
+        for( int64_t duration : section->durations ) { total += (double) duration; }
+        return section->durations.empty() ? 0.0 : total / section->durations.size();
+    };
+    std::sort( noteworthy.begin(), noteworthy.end(), [&]( const SectionHistory* a, const SectionHistory* b )
+    {
+        return ( a->FlakeRate() + 0.01 ) * mean( a ) > ( b->FlakeRate() + 0.01 ) * mean( b );
+    } );
+
+    std::string out = "Flaky or slowing sections:";
+    for( const SectionHistory* section : noteworthy )
+    {
+        out += std::format( "\n  {}{}" ANSI_RESET ANSI_GRAY ": failed {} of {} runs, flake rate {:.1f}%, mean {}",
+            section->flips > 0 ? ANSI_RED : ANSI_RESET, section->path, section->failures, section->runs,
+            100.0 * section->FlakeRate(), FormatDuration( std::chrono::duration< double, std::nano >( mean( section ) ) ) );
+        if( section->Trend() != 0.0 )
+        {
+            out += std::format( ", recent runs {:+.1f}%", 100.0 * section->Trend() );
+        }
+        out += ANSI_RESET;
+    }
+    return out;
+}
+
+std::string TestKit::ReportGenerator::FormatByteRate( double bytesPerSecond )
+{
+    if( bytesPerSecond < 1e3 ) { return std::format( "{:.2f} B/s", bytesPerSecond ); }
+    if( bytesPerSecond < 1e6 ) { return std::format( "{:.2f} kB/s", bytesPerSecond / 1e3 ); }
+    if( bytesPerSecond < 1e9 ) { return std::format( "{:.2f} MB/s", bytesPerSecond / 1e6 ); }
+    return std::format( "{:.2f} GB/s", bytesPerSecond / 1e9 );
+}
+
+std::string TestKit::ReportGenerator::FormatBytes( uint64_t bytes )
+{
+    const char* units[] = { "B", "KB", "MB", "GB", "TB" };
+    double value = (double) bytes;
+    size_t unit = 0;
+    while( value >= 1024.0 && unit + 1 < std::size( units ) ) { value /= 1024.0; unit++; }
+    return value == std::floor( value ) ? std::format( "{:.0f} {}", value, units[unit] ) : std::format( "{:.3g} {}", value, units[unit] );
+}
+
+std::string TestKit::ReportGenerator::StringifyBenchmark( const BenchmarkResult& result )
+{
+    std::string out = std::format( "{} per iteration, {} over {} iterations",
+        FormatDuration( std::chrono::duration< double, std::nano >( result.NanosecondsPerIteration() ) ),
+        FormatRate( result.IterationsPerSecond() ), result.iterations );
+    if( result.itemsPerIteration > 0 ) { out += ", " + FormatRate( result.ItemsPerSecond() ) + " items"; }
+    if( result.bytesPerIteration > 0 ) { out += ", " + FormatByteRate( result.BytesPerSecond() ); }
+    if( result.latency )
+    {
+        const Histogram& latency = *result.latency;
+        out += std::format( ", latency p50 {}, p90 {}, p99 {}, p99.9 {}, max {}",
+            FormatDuration( std::chrono::nanoseconds( latency.Percentile( 50.0 ) ) ), FormatDuration( std::chrono::nanoseconds( latency.Percentile( 90.0 ) ) ),
+            FormatDuration( std::chrono::nanoseconds( latency.Percentile( 99.0 ) ) ), FormatDuration( std::chrono::nanoseconds( latency.Percentile( 99.9 ) ) ),
+            FormatDuration( std::chrono::nanoseconds( latency.Max() ) ) );
+    }
+    return out;
+}
+
+std::string TestKit::ReportGenerator::Stringify( const TestKit::Segment* segment, int depth )
 {
     // ensure segment isn't a nullptr
     if( !segment ) { return ""; }
@@ -195,6 +1172,10 @@ std::string TestKit::ReportGenerator::Stringify( const TestKit::Segment* segment
         out += ANSI_GRAY;
     }
     out += segment->m_name;
+    if( outcome == Outcome::None && !segment->m_blockedBy.empty() )
+    {
+        out += std::format( " (not run, requires '{}')", segment->m_blockedBy );
+    }
     if( outcome != Outcome::None )
     {
         out += ":";
@@ -206,15 +1187,110 @@ std::string TestKit::ReportGenerator::Stringify( const TestKit::Segment* segment
         {
             out += ANSI_ITALIC ANSI_DARK_RED " [some tests failed]";
         }
+        if( segment->m_duration.count() > 0 && segment->m_usage )
+        {
+            const ResourceUsage& usage = *segment->m_usage;
+            out += ANSI_RESET ANSI_GRAY " (" + FormatDuration( segment->m_duration ) + std::format( ", faults {} minor {} major, switches {} voluntary {} involuntary, rss peak {} +{})",
+                usage.minorFaults, usage.majorFaults, usage.voluntarySwitches, usage.involuntarySwitches, FormatBytes( usage.peakRss ), FormatBytes( usage.peakRssGrowth ) );
+        }
+        else if( segment->m_duration.count() > 0 && __internal_curr_options.reportDurations )
+        {
+            out += ANSI_RESET ANSI_GRAY " (" + FormatDuration( segment->m_duration ) + ")";
+        }
         out += ANSI_RESET;
+    }
+
+    bool expand = depth < (uint16_t) __internal_curr_options.detailDepth || outcome == Outcome::Failed; // respect the detail depth. However, failed nodes must be expanded regardless of depth to get more insights
+    if( expand && depth >= 0 )
+    {
+        if( segment->m_benchmark )
+        {
+            out += "\n" + std::string( ( depth + 1 ) * 2, ' ' ) + StringifyBenchmark( *segment->m_benchmark );
+        }
+        for( const std::string& note : segment->m_notes )
+        {
+            out += "\n" + std::string( ( depth + 1 ) * 2, ' ' ) + ANSI_GRAY ANSI_ITALIC + note + ANSI_RESET;
+        }
+    }
+
+    if( outcome != Outcome::None )
+    {
         if( depth < 0 ) { out = ""; } // depth is in the negative, ignore whatever was done for this depth and continue rendering the child
 
-        if( depth < (uint16_t) __internal_curr_options.detailDepth || outcome == Outcome::Failed ) // respect the detail depth. However, failed nodes must be expanded regardless of depth to get more insights
+        if( expand )
         {
+            // the combinations of a sweep are laid out as a table, one row per combination
+            if( !segment->m_sweep.empty() )
+            {
+                bool items = false, bytes = false, latency = false;
+                for( const Segment& combination : segment->m_segments )
+                {
+                    if( !combination.m_benchmark ) { continue; }
+                    items = items || combination.m_benchmark->itemsPerIteration > 0;
+                    bytes = bytes || combination.m_benchmark->bytesPerIteration > 0;
+                    latency = latency || combination.m_benchmark->latency;
+                }
+
+                std::vector< std::vector< std::string > > rows = { segment->m_sweep };
+                rows[0].insert( rows[0].end(), { "time per iteration", "iterations per second" } );
+                if( items ) { rows[0].insert( rows[0].end(), { "time per item", "items per second" } ); }
+                if( bytes ) { rows[0].push_back( "bytes per second" ); }
+                if( latency ) { rows[0].insert( rows[0].end(), { "p50", "p90", "p99", "p99.9", "max" } ); }
+                for( const Segment& combination : segment->m_segments )
+                {
+                    if( !combination.m_benchmark || combination.Check() == Outcome::Failed ) { continue; }
+                    const BenchmarkResult& result = *combination.m_benchmark;
+
+                    // the name of a combination holds its "/" separated cell for every sweep column
+                    std::vector< std::string > row;
+                    for( size_t start = 0, end = 0; end != std::string::npos && row.size() < segment->m_sweep.size(); start = end + 1 )
+                    {
+                        end = combination.m_name.find( '/', start );
+                        row.push_back( combination.m_name.substr( start, end == std::string::npos ? end : end - start ) );
+                    }
+                    row.push_back( FormatDuration( std::chrono::duration< double, std::nano >( result.NanosecondsPerIteration() ) ) );
+                    row.push_back( FormatRate( result.IterationsPerSecond() ) );
+                    if( items && result.itemsPerIteration > 0 )
+                    {
+                        row.push_back( FormatDuration( std::chrono::duration< double, std::nano >( result.NanosecondsPerIteration() / result.itemsPerIteration ) ) );
+                        row.push_back( FormatRate( result.ItemsPerSecond() ) );
+                    }
+                    else if( items ) { row.insert( row.end(), { "-", "-" } ); }
+                    if( bytes ) { row.push_back( result.bytesPerIteration > 0 ? FormatByteRate( result.BytesPerSecond() ) : "-" ); }
+                    for( double percentile : { 50.0, 90.0, 99.0, 99.9, 100.0 } )
+                    {
+                        if( !latency ) { break; }
+                        row.push_back( result.latency ? FormatDuration( std::chrono::nanoseconds( result.latency->Percentile( percentile ) ) ) : "-" );
+                    }
+                    rows.push_back( row );
+                }
+
+                auto width = []( const std::string& text ) { return (size_t) std::count_if( text.begin(), text.end(), []( char c ) { return ( c & 0xC0 ) != 0x80; } ); }; // utf-8 code points
+                std::vector< size_t > widths( rows[0].size(), 0 );
+                for( const auto& row : rows )
+                {
+                    for( size_t i = 0; i < row.size() && i < widths.size(); i++ ) { widths[i] = std::max( widths[i], width( row[i] ) ); }
+                }
+
+                out += "\n";
+                for( size_t r = 0; r < rows.size(); r++ )
+                {
+                    out += "\n" + std::string( ( depth + 1 ) * 2, ' ' ) + ( r == 0 ? ANSI_GRAY : "" );
+                    for( size_t i = 0; i < rows[r].size() && i < widths.size(); i++ )
+                    {
+                        out += rows[r][i];
+                        if( i + 1 < rows[r].size() ) { out += std::string( widths[i] - width( rows[r][i] ) + 3, ' ' ); }
+                    }
+                    out += ANSI_RESET;
+                }
+            }
+
             for( auto node : segment->m_nodes )
             {
                 if( Segment* subSegment = dynamic_cast< Segment* >( node ) )
                 {
+                    if( !segment->m_sweep.empty() && subSegment->m_benchmark && subSegment->Check() != Outcome::Failed ) { continue; } // already in the table
+
                     if( !out.ends_with( "\n" ) ) { out += "\n"; } // segment padding
                     out += "\n" + Stringify( subSegment, depth + 1 ) + "\n";
                 }
@@ -248,9 +1324,30 @@ TestKit::Task TestKit::Task::Build( std::string name, std::source_location sourc
 {
     TestKit::Task out = Build( name, source );
     out.m_outcome = result ? Outcome::Passed : Outcome::Failed;
+    out.m_passes = result ? 1 : 0;
+    out.m_failures = result ? 0 : 1;
     return out;
 }
 
+bool TestKit::Task::Matches( const Task& other ) const
+{
+    return m_source.line() == other.m_source.line()
+        && m_source.column() == other.m_source.column()
+        && std::string_view( m_source.file_name() ) == other.m_source.file_name()
+        && m_name == other.m_name;
+}
+
+void TestKit::Task::Merge( const Task& other )
+{
+    m_runs += other.m_runs;
+    m_passes += other.m_passes;
+    m_failures += other.m_failures;
+
+    // a single failing run fails the whole aggregate
+    if( m_failures > 0 )    { m_outcome = Outcome::Failed; }
+    else if( m_passes > 0 ) { m_outcome = Outcome::Passed; }
+}
+
 TestKit::Outcome TestKit::Task::Check() const
 {
     return m_outcome;
@@ -266,25 +1363,115 @@ TestKit::Segment TestKit::Segment::Build( std::string name )
     return out;
 }
 
+TestKit::Segment TestKit::Segment::BuildAggregate( std::string name )
+{
+    TestKit::Segment out = Build( name );
+    out.m_aggregate = true;
+    return out;
+}
+
 TestKit::Segment* TestKit::Segment::AddSegment( Segment segment )
 {
+    UntrackedScope untracked;
+    if( m_aggregate )
+    {
+        // re-entering a segment folds into the existing one, starting fresh from the parent's failure state
+        for( Segment& existing : m_segments )
+        {
+            if( existing.m_name != segment.m_name ) { continue; }
+            existing.m_didFail = m_didFail;
+            return &existing;
+        }
+        segment.m_aggregate = true;
+    }
+
     segment.m_didFail = m_didFail;
-    m_segments.push_back( segment );
+    m_segments.push_back( std::move( segment ) ); // moving keeps the node pointers of a populated segment valid
     m_nodes.push_back( &m_segments.back() );
     return &m_segments.back();
 }
 
 TestKit::Task* TestKit::Segment::AddTask( Task task )
 {
+    UntrackedScope untracked;
+    if( ::TestKit::__internal_reporter.Enabled() ) { ::TestKit::__internal_reporter.Publish( Event::Make( Event::Type::Task, task.m_outcome, task.m_name ) ); }
+    ::TestKit::__internal_notify( [&]( Listener* listener ) { listener->OnTask( task.m_name, task.m_outcome, task.m_source ); } );
+    return InsertTask( std::move( task ) );
+}
+
+TestKit::Task* TestKit::Segment::InsertTask( Task task )
+{
+    if( m_aggregate )
+    {
+        for( Task& existing : m_tasks )
+        {
+            if( !existing.Matches( task ) ) { continue; }
+            existing.Merge( task );
+            return &existing;
+        }
+    }
+
     m_tasks.push_back( task );
     m_nodes.push_back( &m_tasks.back() );
     return &m_tasks.back();
 }
 
+void TestKit::Segment::AddNote( std::string note )
+{
+    UntrackedScope untracked;
+    m_notes.push_back( note );
+}
+
+void TestKit::Segment::MarkBlocked( std::string prerequisite, std::source_location source )
+{
+    UntrackedScope untracked;
+    AddTask( Task::Build( std::format( "requires '{}'", prerequisite ), source ) );
+    m_blockedBy = prerequisite;
+    m_didFail = true;
+}
+
+void TestKit::Segment::AddUsage( const ResourceUsage& usage )
+{
+    if( !m_usage ) { m_usage.emplace(); }
+    m_usage->Accumulate( usage );
+}
+
+void TestKit::Segment::Merge( const Segment& other )
+{
+    UntrackedScope untracked;
+    if( other.m_didFail ) { m_didFail = true; }
+    if( m_blockedBy.empty() ) { m_blockedBy = other.m_blockedBy; }
+    m_duration += other.m_duration;
+    if( other.m_usage ) { AddUsage( *other.m_usage ); }
+    m_notes.insert( m_notes.end(), other.m_notes.begin(), other.m_notes.end() );
+    if( other.m_benchmark )
+    {
+        if( m_benchmark ) { m_benchmark->Merge( *other.m_benchmark ); }
+        else { m_benchmark = other.m_benchmark; }
+    }
+    for( const std::string& title : other.m_sweep )
+    {
+        if( std::find( m_sweep.begin(), m_sweep.end(), title ) == m_sweep.end() ) { m_sweep.push_back( title ); }
+    }
+
+    for( auto node : other.m_nodes )
+    {
+        if( const Segment* subSegment = dynamic_cast< const Segment* >( node ) )
+        {
+            Segment* target = AddSegment( Segment::Build( subSegment->m_name ) );
+            target->Merge( *subSegment );
+        }
+        else if( const Task* subTask = dynamic_cast< const Task* >( node ) )
+        {
+            InsertTask( *subTask );
+        }
+    }
+}
+
 TestKit::Outcome TestKit::Segment::Check() const
 {
-    // no nodes to run in this segment
-    if( m_nodes.size() == 0 ) { return Outcome::None; }
+    // no nodes to run in this segment, a measured benchmark still counts as having run
+    if( m_nodes.size() == 0 ) { return m_benchmark ? Outcome::Passed : Outcome::None; }
 
     bool allPassed  = true;
     bool allAreNone = true;
@@ -308,97 +1495,2615 @@ TestKit::Outcome TestKit::Segment::Check() const
     return Outcome::Failed;
 }
 
+// ----------------------------------------------------------------------------
+// TestKit Resource Usage implementation
+// ----------------------------------------------------------------------------
+TestKit::ResourceUsage TestKit::ResourceUsage::Sample()
+{
+    ResourceUsage usage;
+#if defined( __linux__ ) && defined( RUSAGE_THREAD )
+    rusage counters;
+    if( getrusage( RUSAGE_THREAD, &counters ) == 0 )
+    {
+        usage.minorFaults = (uint64_t) counters.ru_minflt;
+        usage.majorFaults = (uint64_t) counters.ru_majflt;
+        usage.voluntarySwitches = (uint64_t) counters.ru_nvcsw;
+        usage.involuntarySwitches = (uint64_t) counters.ru_nivcsw;
+    }
+
+    // getrusage only knows the high-water mark of the whole process in ru_maxrss, the status file has the same value without the rounding to pages
+    std::ifstream status( "/proc/self/status" );
+    std::string line;
+    while( std::getline( status, line ) )
+    {
+        if( !line.starts_with( "VmHWM:" ) ) { continue; }
+        usage.peakRss = std::strtoull( line.c_str() + 6, nullptr, 10 ) * 1024; // reported in kB
+        break;
+    }
+#endif
+    return usage;
+}
+
+TestKit::ResourceUsage TestKit::ResourceUsage::Since( const ResourceUsage& start ) const
+{
+    ResourceUsage delta;
+    delta.minorFaults = minorFaults - start.minorFaults;
+    delta.majorFaults = majorFaults - start.majorFaults;
+    delta.voluntarySwitches = voluntarySwitches - start.voluntarySwitches;
+    delta.involuntarySwitches = involuntarySwitches - start.involuntarySwitches;
+    delta.peakRss = peakRss;
+    delta.peakRssGrowth = peakRss > start.peakRss ? peakRss - start.peakRss : 0;
+    return delta;
+}
+
+void TestKit::ResourceUsage::Accumulate( const ResourceUsage& other )
+{
+    minorFaults += other.minorFaults;
+    majorFaults += other.majorFaults;
+    voluntarySwitches += other.voluntarySwitches;
+    involuntarySwitches += other.involuntarySwitches;
+    peakRss = std::max( peakRss, other.peakRss );
+    peakRssGrowth += other.peakRssGrowth;
+}
+
 // ----------------------------------------------------------------------------
 // TestKit Segment Scope Manager implementation
 // ----------------------------------------------------------------------------
-TestKit::SegmentScopeManager::SegmentScopeManager( std::string name )
+TestKit::SegmentScopeManager::SegmentScopeManager( std::string name, std::source_location source ) : m_source( source )
 {
+    UntrackedScope untracked;
+    std::string& path = ::TestKit::__internal_section_path;
+    m_pathLength = path.size();
+    path += path.empty() ? name : "/" + name;
+
+    // filtered sections are left out of the report
+    m_enabled = ::TestKit::__internal_section_enabled( path );
+    if( !m_enabled ) { return; }
+
     Segment* top = ::TestKit::__internal_segment_stack.top();
-    Segment* newSegment = top->AddSegment( Segment::Build( name ) );
-    ::TestKit::__internal_segment_stack.push( newSegment );
+    m_segment = top->AddSegment( Segment::Build( name ) );
+    ::TestKit::__internal_segment_stack.push( m_segment );
+    if( ::TestKit::__internal_reporter.Enabled() ) { ::TestKit::__internal_reporter.Publish( Event::Make( Event::Type::SectionEnter, Outcome::None, path ) ); }
+    ::TestKit::__internal_notify( [&]( Listener* listener ) { listener->OnSectionEnter( path ); } );
+    if( ::TestKit::__internal_curr_options.resourceUsage ) { m_usage = ResourceUsage::Sample(); }
+#if defined( TESTKIT_TRACK_ALLOCATIONS )
+    m_tracker.Enter();
+#endif
+    m_start = Clock::now();
+}
+
+TestKit::SegmentScopeManager::SegmentScopeManager( std::string name, uint64_t peakBudget, std::source_location source ) : SegmentScopeManager( name, source )
+{
+    m_budget = peakBudget;
+#if !defined( TESTKIT_TRACK_ALLOCATIONS )
+    // a not-run task would turn the otherwise passing section into a failure, so the missing check is only pointed out
+    if( m_enabled )
+    {
+        m_segment->AddNote( std::format( "⚠ peak memory budget of {} not checked, define TESTKIT_TRACK_ALLOCATIONS to track allocations", ReportGenerator::FormatBytes( peakBudget ) ) );
+    }
+#endif
 }
 
 TestKit::SegmentScopeManager::~SegmentScopeManager()
 {
+    std::string& path = ::TestKit::__internal_section_path;
+    if( !m_enabled )
+    {
+        path.resize( m_pathLength );
+        return;
+    }
+
+    auto end = Clock::now();
+#if defined( TESTKIT_TRACK_ALLOCATIONS )
+    m_tracker.Exit( m_segment, m_source, m_budget );
+#endif
+    UntrackedScope untracked;
+    m_segment->AddDuration( end - m_start );
+    if( m_usage ) { m_segment->AddUsage( ResourceUsage::Sample().Since( *m_usage ) ); }
+    if( ::TestKit::__internal_reporter.Enabled() ) { ::TestKit::__internal_reporter.Publish( Event::Make( Event::Type::SectionExit, m_segment->Check(), path ) ); }
+    ::TestKit::__internal_notify( [&]( Listener* listener ) { listener->OnSectionExit( path, m_segment->Check(), end - m_start ); } );
+    path.resize( m_pathLength );
     assert( ::TestKit::__internal_segment_stack.size() > 1 );
     ::TestKit::__internal_segment_stack.pop();
 }
 
-TestKit::SegmentScopeManager::operator bool()
+// ----------------------------------------------------------------------------
+// TestKit Async Section implementation
+// ----------------------------------------------------------------------------
+TestKit::AsyncSection::AsyncSection() {}
+
+TestKit::AsyncSection::AsyncSection( std::string name, const AsyncSection& parent )
 {
-    return true;
+    UntrackedScope untracked;
+    m_path = parent.m_segment ? parent.m_path : ::TestKit::__internal_section_path;
+    m_path += m_path.empty() ? name : "/" + name;
+    m_enabled = ::TestKit::__internal_section_enabled( m_path );
+    if( !m_enabled ) { return; }
+
+    {
+        std::lock_guard< std::mutex > lock( ::TestKit::__internal_async_mutex );
+        Segment* top = parent.m_segment ? parent.m_segment : ::TestKit::__internal_segment_stack.top();
+        m_segment = top->AddSegment( Segment::Build( name ) );
+    }
+
+    if( ::TestKit::__internal_reporter.Enabled() ) { ::TestKit::__internal_reporter.Publish( Event::Make( Event::Type::SectionEnter, Outcome::None, m_path ) ); }
+    ::TestKit::__internal_notify( [&]( Listener* listener ) { listener->OnSectionEnter( m_path ); } );
+    m_start = Clock::now();
 }
 
-// ----------------------------------------------------------------------------
-// TestKit core function implementation
-// ----------------------------------------------------------------------------
-void TestKit::Reset()
+TestKit::AsyncSection::~AsyncSection()
 {
-    __internal_root.m_didFail = false;
-    __internal_root.m_nodes.clear();
-    __internal_root.m_segments.clear();
-    __internal_root.m_tasks.clear();
-    while( __internal_segment_stack.size() > 0 )
+    if( !m_segment ) { return; }
+
+    auto end = Clock::now();
+    UntrackedScope untracked;
+    Outcome outcome;
     {
-        __internal_segment_stack.pop();
+        std::lock_guard< std::mutex > lock( ::TestKit::__internal_async_mutex );
+        m_segment->AddDuration( end - m_start );
+        outcome = m_segment->Check();
     }
-    __internal_segment_stack.push( &__internal_root );
+
+    if( ::TestKit::__internal_reporter.Enabled() ) { ::TestKit::__internal_reporter.Publish( Event::Make( Event::Type::SectionExit, outcome, m_path ) ); }
+    ::TestKit::__internal_notify( [&]( Listener* listener ) { listener->OnSectionExit( m_path, outcome, end - m_start ); } );
 }
 
-std::string TestKit::GenerateReport()
+bool TestKit::AsyncSection::DidFail() const
 {
-    std::string report = ReportGenerator::Stringify( &__internal_root, -1 );
-    report = report.substr( report.find_first_not_of( "\n" ) );
-    return report;
+    std::lock_guard< std::mutex > lock( ::TestKit::__internal_async_mutex );
+    return m_segment ? m_segment->DidFail() : ::TestKit::__internal_segment_stack.top()->DidFail();
+}
+
+void TestKit::AsyncSection::Record( Task task, bool required ) const
+{
+    std::lock_guard< std::mutex > lock( ::TestKit::__internal_async_mutex );
+    Segment* segment = m_segment ? m_segment : ::TestKit::__internal_segment_stack.top();
+    if( required && task.Check() == Outcome::Failed ) { segment->MarkFailed(); }
+    segment->AddTask( std::move( task ) );
 }
 
 // ----------------------------------------------------------------------------
-// Macros
+// TestKit Untracked Scope implementation
 // ----------------------------------------------------------------------------
-#define __INTERNAL_TK_CAT( A, B ) A ## B
-#define __INTERNAL_TK_RECAT( A, B ) __INTERNAL_TK_CAT( A, B )
-#define __INTERNAL_TK_SELECT( NAME, NUM ) __INTERNAL_TK_CAT( NAME ## _, NUM )
+TestKit::UntrackedScope::UntrackedScope()
+{
+#if defined( TESTKIT_TRACK_ALLOCATIONS )
+    ::TestKit::__internal_untracked++;
+#endif
+}
 
-#define __INTERNAL_TK_GET_COUNT( _1, _2, COUNT, ... ) COUNT
-#define __INTERNAL_TK_VA_SIZE( ... ) __INTERNAL_TK_GET_COUNT( __VA_ARGS__, 2, 1 )
+TestKit::UntrackedScope::~UntrackedScope()
+{
+#if defined( TESTKIT_TRACK_ALLOCATIONS )
+    ::TestKit::__internal_untracked--;
+#endif
+}
 
-#define __INTERNAL_TK_VA_SELECT( NAME, ... ) __INTERNAL_TK_SELECT( NAME, __INTERNAL_TK_VA_SIZE(__VA_ARGS__) )(__VA_ARGS__)
+#if defined( TESTKIT_TRACK_ALLOCATIONS )
+// ----------------------------------------------------------------------------
+// TestKit Allocation Tracker implementation
+// ----------------------------------------------------------------------------
+void TestKit::AllocationTracker::Enter()
+{
+    m_parent = ::TestKit::__internal_allocation_tracker;
+    ::TestKit::__internal_allocation_tracker = this;
+}
 
-#define __INTERNAL_UNIQUE_NAME( NAME ) __INTERNAL_TK_RECAT( NAME, __COUNTER__ )
+void TestKit::AllocationTracker::Exit( Segment* segment, std::source_location source, uint64_t budget )
+{
+    UntrackedScope untracked; // the report itself allocates
+    ::TestKit::__internal_allocation_tracker = m_parent;
 
-#define __INTERNAL_TK_REQUIRE_2( msg, condition )                                                   \
-{                                                                                                   \
-    auto top = ::TestKit::__internal_segment_stack.top();                                           \
-    if( top->DidFail() )                                                                            \
-    {                                                                                               \
-        top->AddTask( ::TestKit::Task::Build( msg, std::source_location::current() ) );             \
-    }                                                                                               \
-    else                                                                                            \
-    {                                                                                               \
-        bool c = condition; /* caching to prevent re-evaluation */                                  \
-        if( !c ) { top->MarkFailed(); }                                                             \
-        top->AddTask( ::TestKit::Task::Build( msg, std::source_location::current(), c ) );          \
-    }                                                                                               \
+    // turn a sampled backtrace into "frame ← frame ← frame", the allocation hooks themselves are left out when sampling
+    auto describe = []( const AllocationHeader* header ) -> std::string
+    {
+        std::string site;
+#if defined( __linux__ )
+        if( header->m_frames == nullptr ) { return site; }
+        char** symbols = backtrace_symbols( header->m_frames, header->m_depth );
+        for( int i = 0; i < header->m_depth && symbols; i++ )
+        {
+            // symbols look like "binary(mangled+0x1a) [0x4012f4]", keep the demangled function when there is one
+            std::string symbol = symbols[i];
+            size_t open = symbol.find( '(' ), plus = symbol.find( '+', open );
+            if( open != std::string::npos && plus != std::string::npos && plus > open + 1 )
+            {
+                symbol = symbol.substr( open + 1, plus - open - 1 );
+                int status = -1;
+                char* demangled = abi::__cxa_demangle( symbol.c_str(), nullptr, nullptr, &status );
+                if( status == 0 && demangled ) { symbol = demangled; }
+                std::free( demangled );
+            }
+            site += ( i == 0 ? "" : " ← " ) + symbol;
+        }
+        std::free( symbols );
+#else
+        (void) header;
+#endif
+        return site;
+    };
+
+    struct Site
+    {
+        uint64_t bytes = 0;     // live bytes allocated from this site
+        uint64_t count = 0;     // live allocations made from this site
+    };
+    std::map< std::string, Site > sites;
+    uint64_t leakedBytes = 0, leakedCount = 0;
+    {
+        std::lock_guard lock( ::TestKit::__internal_allocation_mutex );
+
+        // a section that freed at least as much as it allocated only left behind replacements, such as a container it grew. A nested
+        // section may also have filled something its parent still owns, so only the outermost section decides what leaked
+        bool leaked = m_parent == nullptr && m_balance > 0 && m_live != nullptr;
+        if( leaked )
+        {
+            leakedBytes = m_liveBytes;
+            leakedCount = m_liveCount;
+        }
+
+        // leaks are reported once and then forgotten, everything else is still live in the enclosing section
+        AllocationTracker* heir = leaked ? nullptr : m_parent;
+        for( AllocationHeader* header = m_live; header != nullptr; )
+        {
+            AllocationHeader* next = header->m_next;
+            if( leaked )
+            {
+                Site& site = sites[describe( header )];
+                site.bytes += header->m_size;
+                site.count++;
+            }
+
+            header->m_prev = header->m_next = nullptr;
+            header->m_tracker = nullptr;
+            if( heir ) { heir->Link( header ); }
+            header = next;
+        }
+        m_live = nullptr;
+        m_liveBytes = m_liveCount = 0;
+    }
+    if( m_parent )
+    {
+        // the peak of this section sits on top of whatever the parent held when the section was entered
+        m_parent->m_peak = std::max( m_parent->m_peak, m_parent->m_balance + m_peak );
+        m_parent->m_balance += m_balance - (int64_t) leakedBytes;
+    }
+
+    // sections with their own budget always report it, the default from the options only speaks up when it is blown
+    uint64_t peak = (uint64_t) std::max< int64_t >( m_peak, 0 );
+    bool own = budget > 0;
+    if( !own ) { budget = ::TestKit::__internal_curr_options.peakMemoryBudget; }
+    if( budget > 0 && ( own || peak > budget ) )
+    {
+        segment->AddTask( Task::Build( std::format( "peak heap within budget (actual {}, allowed {})", ReportGenerator::FormatBytes( peak ),
+            ReportGenerator::FormatBytes( budget ) ), source, peak <= budget ) );
+    }
+    if( leakedCount == 0 ) { return; }
+
+    segment->AddTask( Task::Build( std::format( "no memory leaked ({} in {} {} still live)", ReportGenerator::FormatBytes( leakedBytes ),
+        leakedCount, leakedCount == 1 ? "allocation" : "allocations" ), source, false ) );
+
+    // the sites holding the most memory first
+    std::vector< std::pair< std::string, Site > > sorted( sites.begin(), sites.end() );
+    std::sort( sorted.begin(), sorted.end(), []( const auto& a, const auto& b ) { return a.second.bytes > b.second.bytes; } );
+    constexpr size_t shown = 5;
+    for( size_t i = 0; i < sorted.size() && i < shown; i++ )
+    {
+        const auto& [site, leak] = sorted[i];
+        segment->AddNote( std::format( "{} in {} {} {}", ReportGenerator::FormatBytes( leak.bytes ), leak.count, leak.count == 1 ? "allocation" : "allocations",
+            site.empty() ? "without a sampled backtrace" : "from " + site ) );
+    }
+    if( sorted.size() > shown ) { segment->AddNote( std::format( "and {} more allocation sites", sorted.size() - shown ) ); }
 }
 
-#define __INTERNAL_TK_CHECK_2( msg, condition )                                                     \
-{                                                                                                   \
-    auto top = ::TestKit::__internal_segment_stack.top();                                           \
-    if( top->DidFail() )                                                                            \
-    {                                                                                               \
-        top->AddTask( ::TestKit::Task::Build( msg, std::source_location::current() ) );             \
-    }                                                                                               \
-    else                                                                                            \
-    {                                                                                               \
-        top->AddTask( ::TestKit::Task::Build( msg, std::source_location::current(), condition ) );  \
-    }                                                                                               \
+void TestKit::AllocationTracker::Link( AllocationHeader* header )
+{
+    header->m_tracker = this;
+    header->m_prev = nullptr;
+    header->m_next = m_live;
+    if( m_live ) { m_live->m_prev = header; }
+    m_live = header;
+    m_liveBytes += header->m_size;
+    m_liveCount++;
 }
 
-#define __INTERNAL_TK_REQUIRE_1( condition ) __INTERNAL_TK_REQUIRE_2( #condition, condition )
-#define __INTERNAL_TK_CHECK_1( condition ) __INTERNAL_TK_CHECK_2( #condition, condition )
+void TestKit::AllocationTracker::Unlink( AllocationHeader* header )
+{
+    if( header->m_prev ) { header->m_prev->m_next = header->m_next; }
+    else { m_live = header->m_next; }
+    if( header->m_next ) { header->m_next->m_prev = header->m_prev; }
+    header->m_prev = header->m_next = nullptr;
+    header->m_tracker = nullptr;
+    m_liveBytes -= header->m_size;
+    m_liveCount--;
+}
+#endif
+
+// ----------------------------------------------------------------------------
+// TestKit Event implementation
+// ----------------------------------------------------------------------------
+TestKit::Event TestKit::Event::Make( Type type, Outcome outcome, std::string_view name )
+{
+    thread_local uint32_t thread = ::TestKit::__internal_thread_ids++;
+
+    Event event;
+    event.type = type;
+    event.outcome = (uint8_t) outcome;
+    event.length = (uint16_t) std::min( name.size(), sizeof( event.name ) );
+    event.thread = thread;
+    event.time = std::chrono::duration_cast< std::chrono::nanoseconds >( Clock::now() - ::TestKit::__internal_event_epoch ).count();
+    std::copy_n( name.data(), event.length, event.name );
+    return event;
+}
+
+// ----------------------------------------------------------------------------
+// TestKit Event Queue implementation
+// ----------------------------------------------------------------------------
+TestKit::EventQueue::EventQueue( size_t capacity )
+{
+    capacity = std::bit_ceil( std::max< size_t >( capacity, 2 ) );
+    m_cells = std::make_unique< Cell[] >( capacity );
+    m_mask = capacity - 1;
+    for( size_t i = 0; i < capacity; i++ ) { m_cells[i].sequence.store( i, std::memory_order_relaxed ); }
+    m_tail.store( 0, std::memory_order_relaxed );
+}
+
+bool TestKit::EventQueue::Push( const Event& event )
+{
+    uint64_t position = m_tail.load( std::memory_order_relaxed );
+    while( true )
+    {
+        Cell& cell = m_cells[position & m_mask];
+        int64_t lap = (int64_t) ( cell.sequence.load( std::memory_order_acquire ) - position );
+        if( lap == 0 )
+        {
+            // the cell is free for this position, claim it before another producer does
+            if( m_tail.compare_exchange_weak( position, position + 1, std::memory_order_relaxed ) )
+            {
+                cell.event = event;
+                cell.sequence.store( position + 1, std::memory_order_release );
+                return true;
+            }
+        }
+        else if( lap < 0 )
+        {
+            return false; // the consumer has not read this cell from the previous lap yet
+        }
+        else
+        {
+            position = m_tail.load( std::memory_order_relaxed ); // another producer got here first
+        }
+    }
+}
+
+bool TestKit::EventQueue::Pop( Event& event )
+{
+    Cell& cell = m_cells[m_head & m_mask];
+    if( cell.sequence.load( std::memory_order_acquire ) != m_head + 1 ) { return false; }
+
+    event = cell.event;
+    cell.sequence.store( m_head + m_mask + 1, std::memory_order_release ); // free for the next lap
+    m_head++;
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+// TestKit Event Reporter implementation
+// ----------------------------------------------------------------------------
+TestKit::EventReporter::~EventReporter()
+{
+    Stop();
+}
+
+void TestKit::EventReporter::Start( const Options& options )
+{
+    m_backpressure = options.backpressure;
+    bool same = options.progressSocket == m_socketPath && options.eventLog == m_logPath && options.spillFile == m_spillPath;
+    if( same && m_reporter.joinable() ) { return; }
+    Stop();
+
+    m_socketPath = options.progressSocket;
+    m_logPath = options.eventLog;
+    {
+        std::lock_guard lock( m_spillMutex );
+        m_spillPath = options.spillFile;
+        m_spillClosed = false;
+    }
+#if !defined( __linux__ )
+    m_socketPath.clear(); // sockets and pipes are only published to on linux
+#endif
+    if( m_socketPath.empty() && m_logPath.empty() ) { return; }
+
+    ::TestKit::__internal_event_epoch = Clock::now();
+    m_stop = false;
+    m_dropped = 0;
+    m_stalled = false;
+    m_enabled = true;
+    m_reporter = std::thread( &EventReporter::Report, this );
+}
+
+void TestKit::EventReporter::Stop()
+{
+    m_enabled = false;
+    m_stop = true;
+    if( m_reporter.joinable() ) { m_reporter.join(); }
+}
+
+void TestKit::EventReporter::Publish( const Event& event )
+{
+    if( !Enabled() ) { return; }
+    if( m_queue.Push( event ) )
+    {
+        if( m_stalled.load( std::memory_order_relaxed ) ) { m_stalled.store( false, std::memory_order_relaxed ); }
+        return;
+    }
+
+    // a stalled reporter must not hang the tests, so waiting for room is bounded and skipped until the queue drains again.
+    // what still finds no room is spilled, unless it is a passing event the policy lets go
+    Backpressure policy = m_backpressure.load( std::memory_order_relaxed );
+    bool failed = event.outcome == (uint8_t) Outcome::Failed;
+    if( ( policy == Backpressure::Block || ( policy == Backpressure::DropPassing && failed ) ) && !m_stalled.load( std::memory_order_relaxed ) )
+    {
+        Clock::time_point deadline = Clock::now() + std::chrono::milliseconds( 100 );
+        while( Enabled() && Clock::now() < deadline )
+        {
+            if( m_queue.Push( event ) ) { return; }
+            std::this_thread::sleep_for( std::chrono::microseconds( 50 ) );
+        }
+        m_stalled.store( true, std::memory_order_relaxed );
+    }
+
+    if( ( policy != Backpressure::DropPassing || failed ) && Spill( event ) ) { return; }
+    m_dropped++;
+}
+
+bool TestKit::EventReporter::Spill( const Event& event )
+{
+    std::lock_guard lock( m_spillMutex );
+    if( m_spillClosed || m_spillPath.empty() ) { return false; }
+    if( m_spill == nullptr ) { m_spill = std::fopen( m_spillPath.c_str(), "w+b" ); }
+    return m_spill && std::fwrite( &event, sizeof( event ), 1, m_spill ) == 1;
+}
+
+void TestKit::EventReporter::Report()
+{
+#if defined( __linux__ )
+    // a listener going away must show up as a failed write, not as a SIGPIPE killing the tests
+    sigset_t pipe;
+    sigemptyset( &pipe );
+    sigaddset( &pipe, SIGPIPE );
+    pthread_sigmask( SIG_BLOCK, &pipe, nullptr );
+#endif
+
+    if( m_logPath == "-" ) { m_log = stdout; }
+    else if( !m_logPath.empty() ) { m_log = std::fopen( m_logPath.c_str(), "w" ); }
+    m_lastAttempt = Clock::now() - std::chrono::seconds( 1 );
+
+    Event event;
+    while( true )
+    {
+        if( m_queue.Pop( event ) )
+        {
+            Deliver( event );
+            continue;
+        }
+        if( m_stop.load() ) { break; }
+        if( m_log ) { std::fflush( m_log ); } // the log is caught up, let readers see it
+        std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+    }
+
+    // the spilled events arrive last, out of order with what was queued meanwhile but none of them lost
+    {
+        std::lock_guard lock( m_spillMutex );
+        m_spillClosed = true;
+        if( m_spill )
+        {
+            std::rewind( m_spill );
+            while( std::fread( &event, sizeof( event ), 1, m_spill ) == 1 ) { Deliver( event ); }
+            std::fclose( m_spill );
+            std::remove( m_spillPath.c_str() );
+            m_spill = nullptr;
+        }
+    }
+
+    if( m_log )
+    {
+        if( m_dropped > 0 ) { std::fputs( std::format( "{} events were dropped because the event queue was full\n", m_dropped.load() ).c_str(), m_log ); }
+        if( m_log == stdout ) { std::fflush( m_log ); }
+        else { std::fclose( m_log ); }
+        m_log = nullptr;
+    }
+#if defined( __linux__ )
+    if( m_socket >= 0 ) { close( m_socket ); }
+#endif
+    m_socket = -1;
+}
+
+void TestKit::EventReporter::Deliver( const Event& event )
+{
+    if( m_log )
+    {
+        // one readable line per event, such as "[   12.35 ms] thread 0 ✓ a + b == 3"
+        const char* marks[] = { CIRCLE_SYM, CROSS_MARK, CHECK_MARK };
+        const char* mark = event.outcome < 3 ? marks[event.outcome] : "?";
+        std::string_view name( event.name, event.length );
+        std::string line = std::format( "[{:>12}] thread {} ", ReportGenerator::FormatDuration( std::chrono::nanoseconds( event.time ) ), event.thread );
+        switch( event.type )
+        {
+            case Event::Type::SectionEnter: line += std::format( "enter {}\n", name ); break;
+            case Event::Type::SectionExit:  line += std::format( "exit  {} {}\n", name, mark ); break;
+            case Event::Type::Task:         line += std::format( "{} {}\n", mark, name ); break;
+        }
+        std::fputs( line.c_str(), m_log );
+    }
+
+#if defined( __linux__ )
+    if( m_socketPath.empty() ) { return; }
+
+    // keep trying to reach the listener once a second, events published while nobody listens are lost. once stopping,
+    // whatever is still queued only goes to a listener that is already connected
+    if( m_socket < 0 && !m_stop.load() && Clock::now() - m_lastAttempt >= std::chrono::seconds( 1 ) )
+    {
+        m_socket = Connect();
+        m_lastAttempt = Clock::now();
+    }
+    if( m_socket < 0 ) { return; }
+
+    char message[4 + 16 + sizeof( event.name )];
+    uint32_t payload = 16 + event.length;
+    size_t offset = 0;
+    auto put = [&]( const void* data, size_t size ) { std::memcpy( message + offset, data, size ); offset += size; };
+    put( &payload, sizeof( payload ) );
+    put( &event.type, sizeof( event.type ) );
+    put( &event.outcome, sizeof( event.outcome ) );
+    put( &event.thread, sizeof( event.thread ) );
+    put( &event.time, sizeof( event.time ) );
+    put( &event.length, sizeof( event.length ) );
+    put( event.name, event.length );
+
+    // a full socket or pipe is waited on here, on the reporter thread, never on the tests. a listener that stops reading
+    // for a second, or for a tenth of one while the reporter is stopping, is dropped like one that went away
+    Clock::time_point progress = Clock::now();
+    for( size_t written = 0; written < offset; )
+    {
+        ssize_t result = ::write( m_socket, message + written, offset - written );
+        if( result > 0 ) { written += (size_t) result; progress = Clock::now(); continue; }
+        if( result < 0 && errno == EINTR ) { continue; }
+
+        auto patience = m_stop.load() ? std::chrono::milliseconds( 100 ) : std::chrono::milliseconds( 1000 );
+        if( result < 0 && errno == EAGAIN && Clock::now() - progress < patience )
+        {
+            pollfd writable = { .fd = m_socket, .events = POLLOUT, .revents = 0 };
+            poll( &writable, 1, 100 );
+            continue;
+        }
+
+        close( m_socket );
+        m_socket = -1;
+        m_dropped++;
+        break;
+    }
+#endif
+}
+
+int TestKit::EventReporter::Connect() const
+{
+#if defined( __linux__ )
+    struct stat info;
+    if( stat( m_socketPath.c_str(), &info ) != 0 ) { return -1; }
+
+    if( S_ISFIFO( info.st_mode ) )
+    {
+        return open( m_socketPath.c_str(), O_WRONLY | O_NONBLOCK | O_CLOEXEC ); // fails with ENXIO until a reader opened the pipe
+    }
+
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if( m_socketPath.size() >= sizeof( address.sun_path ) ) { return -1; }
+    std::copy( m_socketPath.begin(), m_socketPath.end(), address.sun_path );
+
+    int fd = socket( AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0 ); // a listener with a full backlog refuses instead of blocking
+    if( fd >= 0 && connect( fd, (sockaddr*) &address, sizeof( address ) ) != 0 )
+    {
+        close( fd );
+        fd = -1;
+    }
+    return fd;
+#else
+    return -1;
+#endif
+}
+
+// ----------------------------------------------------------------------------
+// TestKit Section History implementation
+// ----------------------------------------------------------------------------
+double TestKit::SectionHistory::FlakeRate() const
+{
+    return runs > 1 ? (double) flips / ( runs - 1 ) : 0.0;
+}
+
+double TestKit::SectionHistory::Trend() const
+{
+    // compare the last few runs against everything before them, too little history shows no trend
+    constexpr size_t recent = 5;
+    if( durations.size() < recent * 2 ) { return 0.0; }
+
+    double older = 0.0, newer = 0.0;
+    for( size_t i = 0; i < durations.size(); i++ )
+    {
+        ( i < durations.size() - recent ? older : newer ) += (double) durations[i];
+    }
+    older /= durations.size() - recent;
+    newer /= recent;
+    return older > 0.0 ? newer / older - 1.0 : 0.0;
+}
+
+TestKit::SegmentScopeManager::operator bool()
+{
+    return m_enabled;
+}
+
+// ----------------------------------------------------------------------------
+// TestKit Measure implementation
+// ----------------------------------------------------------------------------
+std::chrono::nanoseconds TestKit::Measure::Median( const std::function< void() >& block, int samples )
+{
+    constexpr auto target = std::chrono::milliseconds( 1 );   // long enough to dwarf the clock resolution
+    constexpr auto limit = std::chrono::seconds( 1 );         // stop sampling slow blocks once this much time was spent
+
+    // calibrate how many calls make up one sample, the calibration runs double as warm-up
+    uint64_t batch = 1;
+    while( true )
+    {
+        auto start = Clock::now();
+        for( uint64_t i = 0; i < batch; i++ ) { block(); }
+        auto elapsed = Clock::now() - start;
+        if( elapsed >= target || batch >= ( 1ull << 30 ) ) { break; }
+        batch *= elapsed.count() > 0 ? std::clamp< uint64_t >( target / elapsed, 2, 100 ) : 100;
+    }
+
+    std::vector< double > times;
+    auto spent = Clock::duration::zero();
+    for( int i = 0; i < samples && ( i < 3 || spent < limit ); i++ )
+    {
+        auto start = Clock::now();
+        for( uint64_t j = 0; j < batch; j++ ) { block(); }
+        auto elapsed = Clock::now() - start;
+        spent += elapsed;
+        times.push_back( (double) std::chrono::duration_cast< std::chrono::nanoseconds >( elapsed ).count() / batch );
+    }
+
+    std::sort( times.begin(), times.end() );
+    return std::chrono::nanoseconds( (int64_t) times[times.size() / 2] );
+}
+
+// ----------------------------------------------------------------------------
+// TestKit Faster Than Check implementation
+// ----------------------------------------------------------------------------
+TestKit::FasterThanCheck::FasterThanCheck( std::chrono::duration< double, std::nano > budget, std::source_location source ) :
+    m_budget( std::chrono::duration_cast< std::chrono::nanoseconds >( budget ) ), m_source( source ) {}
+
+void TestKit::FasterThanCheck::operator=( std::function< void() > block )
+{
+    Segment* top = ::TestKit::__internal_segment_stack.top();
+    std::string name = "faster than " + ReportGenerator::FormatDuration( m_budget );
+    if( top->DidFail() )
+    {
+        top->AddTask( Task::Build( name, m_source ) );
+        return;
+    }
+
+    std::chrono::nanoseconds median = Measure::Median( block );
+    name += " (median " + ReportGenerator::FormatDuration( median ) + ")";
+    top->AddTask( Task::Build( name, m_source, median <= m_budget ) );
+}
+
+// ----------------------------------------------------------------------------
+// TestKit Range implementation
+// ----------------------------------------------------------------------------
+TestKit::Range TestKit::Range::Pow2( int64_t low, int64_t high )
+{
+    Range out;
+    for( int64_t value = std::max< int64_t >( low, 1 ); value <= high; value *= 2 ) { out.m_values.push_back( value ); }
+    return out;
+}
+
+TestKit::Range TestKit::Range::Linear( int64_t low, int64_t high, int64_t step )
+{
+    Range out;
+    for( int64_t value = low; value <= high && step > 0; value += step ) { out.m_values.push_back( value ); }
+    return out;
+}
+
+TestKit::Range TestKit::Range::Values( std::initializer_list< int64_t > values )
+{
+    Range out;
+    out.m_values = values;
+    return out;
+}
+
+TestKit::Range TestKit::Range::Name( std::string name ) const
+{
+    Range out = *this;
+    out.m_name = name;
+    return out;
+}
+
+// ----------------------------------------------------------------------------
+// TestKit Histogram implementation
+// ----------------------------------------------------------------------------
+void TestKit::Histogram::Record( uint64_t value )
+{
+    // values below 128 get a bucket each, above that the 6 bits after the leading one pick the sub-bucket
+    size_t index = value;
+    if( value >= ( 1ull << SubBucketBits ) )
+    {
+        int shift = std::bit_width( value ) - SubBucketBits;
+        index = ( (size_t) shift << ( SubBucketBits - 1 ) ) + ( value >> shift );
+    }
+
+    if( index >= m_counts.size() ) { m_counts.resize( index + 1, 0 ); }
+    m_counts[index]++;
+    m_count++;
+    m_max = std::max( m_max, value );
+}
+
+uint64_t TestKit::Histogram::Percentile( double percentile ) const
+{
+    if( m_count == 0 ) { return 0; }
+
+    uint64_t rank = (uint64_t) std::ceil( std::clamp( percentile, 0.0, 100.0 ) / 100.0 * m_count );
+    uint64_t seen = 0;
+    for( size_t index = 0; index < m_counts.size(); index++ )
+    {
+        seen += m_counts[index];
+        if( seen < std::max< uint64_t >( rank, 1 ) ) { continue; }
+        if( index < ( 1ull << SubBucketBits ) ) { return index; }
+
+        // report the highest value of the bucket, never beyond the exact maximum
+        int shift = (int) ( index >> ( SubBucketBits - 1 ) ) - 1;
+        uint64_t lowest = (uint64_t) ( ( index & ( ( 1ull << ( SubBucketBits - 1 ) ) - 1 ) ) + ( 1ull << ( SubBucketBits - 1 ) ) ) << shift;
+        return std::min< uint64_t >( lowest + ( 1ull << shift ) - 1, m_max );
+    }
+    return m_max;
+}
+
+void TestKit::Histogram::Clear()
+{
+    m_counts.clear();
+    m_count = 0;
+    m_max = 0;
+}
+
+void TestKit::Histogram::Merge( const Histogram& other )
+{
+    if( other.m_counts.size() > m_counts.size() ) { m_counts.resize( other.m_counts.size(), 0 ); }
+    for( size_t index = 0; index < other.m_counts.size(); index++ ) { m_counts[index] += other.m_counts[index]; }
+    m_count += other.m_count;
+    m_max = std::max( m_max, other.m_max );
+}
+
+// ----------------------------------------------------------------------------
+// TestKit Benchmark Result implementation
+// ----------------------------------------------------------------------------
+void TestKit::BenchmarkResult::Merge( const BenchmarkResult& other )
+{
+    // the totals add up, so the rates become the average over every measurement
+    iterations += other.iterations;
+    elapsed += other.elapsed;
+    cpu += other.cpu;
+    threads = std::max( threads, other.threads );
+    itemsPerIteration = std::max( itemsPerIteration, other.itemsPerIteration );
+    bytesPerIteration = std::max( bytesPerIteration, other.bytesPerIteration );
+    if( other.latency )
+    {
+        if( latency ) { latency->Merge( *other.latency ); }
+        else { latency = other.latency; }
+    }
+}
+
+// ----------------------------------------------------------------------------
+// TestKit Benchmark Runner implementation
+// ----------------------------------------------------------------------------
+void TestKit::BenchmarkRunner::operator=( std::function< void() > body )
+{
+    UntrackedScope untracked; // the results live on in the report, the body's allocations are not what a benchmark checks
+    // checks inside the body run once per iteration, so they are folded together
+    Segment* segment = ::TestKit::__internal_segment_stack.top()->AddSegment( Segment::BuildAggregate( m_name ) );
+    if( segment->DidFail() ) { return; }
+
+    AffinityGuard pin( 0 );
+    ::TestKit::__internal_warn_noise( segment );
+
+    if( m_maxThreads > 0 )
+    {
+        MeasureScaling( segment, body );
+        return;
+    }
+
+    if( m_maxBytes > 0 )
+    {
+        MeasureMemory( segment, body );
+        return;
+    }
+
+    if( m_ranges.empty() )
+    {
+        ::TestKit::__internal_segment_stack.push( segment );
+        segment->m_benchmark = Measure( body, {} );
+        ::TestKit::__internal_segment_stack.pop();
+        return;
+    }
+
+    for( size_t i = 0; i < m_ranges.size(); i++ )
+    {
+        segment->m_sweep.push_back( m_ranges[i].m_name.empty() ? std::format( "arg {}", i ) : m_ranges[i].m_name );
+        if( m_ranges[i].m_values.empty() ) { return; } // an empty range leaves nothing to sweep
+    }
+
+    // walk the cartesian product like an odometer, the last range changes fastest
+    std::vector< size_t > indices( m_ranges.size(), 0 );
+    while( true )
+    {
+        std::vector< int64_t > args;
+        std::string name;
+        for( size_t i = 0; i < m_ranges.size(); i++ )
+        {
+            args.push_back( m_ranges[i].m_values[indices[i]] );
+            name += ( i == 0 ? "" : "/" ) + std::to_string( args.back() );
+        }
+
+        Segment* combination = segment->AddSegment( Segment::Build( name ) );
+        ::TestKit::__internal_segment_stack.push( combination );
+        combination->m_benchmark = Measure( body, args );
+        ::TestKit::__internal_segment_stack.pop();
+
+        size_t digit = m_ranges.size();
+        while( digit > 0 && ++indices[digit - 1] == m_ranges[digit - 1].m_values.size() )
+        {
+            indices[digit - 1] = 0;
+            digit--;
+        }
+        if( digit == 0 ) { break; }
+    }
+}
+
+void TestKit::BenchmarkRunner::MeasureScaling( Segment* segment, const std::function< void() >& body )
+{
+    std::vector< int > counts;
+    for( int count = 1; count < m_maxThreads; count *= 2 ) { counts.push_back( count ); }
+    counts.push_back( m_maxThreads );
+
+    segment->m_sweep = { "threads" };
+    std::vector< double > throughputs;
+    for( int count : counts )
+    {
+        // like a stress test, every thread records its checks into its own segment and everything is merged once the threads joined
+        std::vector< Segment > locals( count, Segment::BuildAggregate( "" ) );
+        std::vector< uint64_t > iterations( count, 0 );
+        std::vector< uint64_t > items( count, 0 ), bytes( count, 0 ); // per iteration, as declared by the body on each thread
+        std::vector< Clock::duration > cpu( count );
+        std::vector< Clock::duration > paused( count );
+        std::latch release( count + 1 ); // the threads and the timer start together
+        uint64_t seed = ::TestKit::__internal_seed; // every thread gets its own seed, derived from the run's so a failure replays
+        std::atomic< bool > stop = false;
+
+        std::vector< std::thread > threads;
+        for( int i = 0; i < count; i++ )
+        {
+            threads.emplace_back( [&, i]()
+            {
+                AffinityGuard pin( i );
+                ::TestKit::__internal_thread_index = i;
+                ::TestKit::__internal_seed = ::TestKit::__internal_derive_seed( seed, i );
+                ::TestKit::__internal_segment_stack.push( &locals[i] );
+                release.arrive_and_wait();
+
+                uint64_t done = 0;
+                ::TestKit::__internal_paused_time = {};
+                auto cpuStart = Clock::ThreadCpuTime();
+                while( !stop.load( std::memory_order_relaxed ) ) { body(); done++; }
+                cpu[i] = std::max( Clock::ThreadCpuTime() - cpuStart - ::TestKit::__internal_paused_time, Clock::duration::zero() );
+                paused[i] = ::TestKit::__internal_paused_time;
+                iterations[i] = done;
+                items[i] = ::TestKit::__internal_benchmark_items;
+                bytes[i] = ::TestKit::__internal_benchmark_bytes;
+
+                ::TestKit::__internal_segment_stack.pop();
+            } );
+        }
+
+        release.arrive_and_wait();
+        auto start = Clock::now();
+        std::this_thread::sleep_for( ::TestKit::__internal_curr_options.benchmarkTime );
+        stop.store( true, std::memory_order_relaxed );
+        for( std::thread& thread : threads ) { thread.join(); }
+        auto elapsed = std::chrono::duration_cast< std::chrono::nanoseconds >( Clock::now() - start );
+
+        // the threads run side by side, so the wall time loses the average time a thread spent paused
+        Clock::duration pausedTotal {};
+        for( Clock::duration spent : paused ) { pausedTotal += spent; }
+        elapsed = std::max( elapsed - pausedTotal / count, std::chrono::nanoseconds::zero() );
+
+        BenchmarkResult result;
+        result.args = { count };
+        result.elapsed = elapsed;
+        result.threads = count;
+        for( uint64_t done : iterations ) { result.iterations += done; }
+        for( Clock::duration spent : cpu ) { result.cpu += spent; }
+        for( uint64_t declared : items ) { result.itemsPerIteration = std::max( result.itemsPerIteration, declared ); }
+        for( uint64_t declared : bytes ) { result.bytesPerIteration = std::max( result.bytesPerIteration, declared ); }
+        throughputs.push_back( result.IterationsPerSecond() );
+
+        Segment* combination = segment->AddSegment( Segment::Build( std::to_string( count ) ) );
+        for( const Segment& local : locals ) { combination->Merge( local ); }
+        combination->m_benchmark = result;
+    }
+
+    // speedup against one thread, efficiency is the speedup shared out over the threads
+    for( size_t i = 0; i < counts.size(); i++ )
+    {
+        double speedup = throughputs[0] > 0.0 ? throughputs[i] / throughputs[0] : 0.0;
+        segment->AddNote( std::format( "{} {}: speedup {:.2f}×, parallel efficiency {:.0f}%", counts[i], counts[i] == 1 ? "thread" : "threads", speedup, 100.0 * speedup / counts[i] ) );
+    }
+    for( size_t i = 1; i < counts.size(); i++ )
+    {
+        if( throughputs[i] >= 0.95 * throughputs[i - 1] ) { continue; } // small dips are measurement noise
+        segment->AddNote( std::format( "⚠ negative scaling: {} threads reach {} while {} reached {}", counts[i],
+            ReportGenerator::FormatRate( throughputs[i] ), counts[i - 1], ReportGenerator::FormatRate( throughputs[i - 1] ) ) );
+    }
+}
+
+void TestKit::BenchmarkRunner::MeasureMemory( Segment* segment, const std::function< void() >& body )
+{
+    std::vector< uint64_t > sizes;
+    for( uint64_t size = 4096; size < m_maxBytes; size *= 2 ) { sizes.push_back( size ); }
+    sizes.push_back( std::max< uint64_t >( m_maxBytes, 4096 ) );
+
+    // the smallest cache holding the whole working set is where its accesses are expected to be served from
+    std::vector< uint64_t > caches = CacheSizes();
+    auto level = [&]( uint64_t size ) -> std::string
+    {
+        for( size_t i = 0; i < caches.size(); i++ )
+        {
+            if( caches[i] > 0 && size <= caches[i] ) { return std::format( "L{}", i + 1 ); }
+        }
+        return caches[0] > 0 ? "DRAM" : "?";
+    };
+
+    std::string known;
+    for( size_t i = 0; i < caches.size(); i++ )
+    {
+        if( caches[i] > 0 ) { known += std::format( "{}L{} {}", known.empty() ? "" : ", ", i + 1, ReportGenerator::FormatBytes( caches[i] ) ); }
+    }
+    segment->AddNote( known.empty() ? "cache sizes unknown, levels are not annotated" : "caches: " + known );
+
+    segment->m_sweep = { "working set", "pattern", "level" };
+    std::mt19937_64 random( 0x7e57c0de ); // a fixed seed keeps the random orders comparable between runs
+    std::string previous;
+    for( uint64_t size : sizes )
+    {
+        // every element holds the index of the element visited after it, both chains are one cycle through the whole set
+        std::vector< uint64_t > chain( size / sizeof( uint64_t ) );
+        for( const char* pattern : { "sequential", "random" } )
+        {
+            for( size_t i = 0; i < chain.size(); i++ ) { chain[i] = ( i + 1 ) % chain.size(); }
+            if( pattern == std::string( "random" ) )
+            {
+                // Sattolo's shuffle turns the identity into a single random cycle, so chasing it visits every element once
+                for( size_t i = chain.size(); i-- > 1; )
+                {
+                    size_t j = std::uniform_int_distribution< size_t >( 0, i - 1 )( random );
+                    std::swap( chain[i], chain[j] );
+                }
+            }
+
+            Segment* combination = segment->AddSegment( Segment::Build( std::format( "{}/{}/{}", ReportGenerator::FormatBytes( size ), pattern, level( size ) ) ) );
+            ::TestKit::__internal_segment_stack.push( combination );
+            ::TestKit::__internal_working_set = chain;
+            combination->m_benchmark = Measure( body, { (int64_t) size } );
+            if( combination->m_benchmark->itemsPerIteration == 0 ) { combination->m_benchmark->itemsPerIteration = chain.size(); } // one pass over the set by default
+            ::TestKit::__internal_working_set = {};
+            ::TestKit::__internal_segment_stack.pop();
+        }
+
+        if( !previous.empty() && level( size ) != previous )
+        {
+            segment->AddNote( std::format( "{} onwards no longer fits {}", ReportGenerator::FormatBytes( size ), previous ) );
+        }
+        previous = level( size );
+    }
+}
+
+TestKit::BenchmarkResult TestKit::BenchmarkRunner::Measure( const std::function< void() >& body, std::vector< int64_t > args )
+{
+    auto minimum = std::chrono::duration_cast< std::chrono::nanoseconds >( ::TestKit::__internal_curr_options.benchmarkTime );
+    ::TestKit::__internal_benchmark_args = args;
+    ::TestKit::__internal_benchmark_items = 0;
+    ::TestKit::__internal_benchmark_bytes = 0;
+
+    // grow the iteration count until a single measurement lasts the benchmark time, the earlier rounds warm up caches and branch predictors
+    BenchmarkResult result;
+    result.args = args;
+    if( m_latency ) { result.latency.emplace(); }
+
+    // the cheapest back to back clock reading is the timer overhead removed from every individually timed iteration
+    int64_t overhead = INT64_MAX;
+    for( int i = 0; i < 1000; i++ )
+    {
+        auto first = Clock::now();
+        overhead = std::min< int64_t >( overhead, std::chrono::duration_cast< std::chrono::nanoseconds >( Clock::now() - first ).count() );
+    }
+
+    // a pause still costs the part of the pause and resume calls outside the paused window, removed once per pause
+    int64_t pauseOverhead = INT64_MAX;
+    for( int i = 0; i < 1000; i++ )
+    {
+        ::TestKit::__internal_paused_time = {};
+        auto first = Clock::now();
+        PauseTiming();
+        ResumeTiming();
+        auto taken = Clock::now() - first - ::TestKit::__internal_paused_time;
+        pauseOverhead = std::min< int64_t >( pauseOverhead, std::chrono::duration_cast< std::chrono::nanoseconds >( taken ).count() - overhead );
+    }
+    pauseOverhead = std::max< int64_t >( pauseOverhead, 0 );
+
+    uint64_t iterations = 1;
+    while( true )
+    {
+        ::TestKit::__internal_paused_time = {};
+        ::TestKit::__internal_pauses = 0;
+        auto cpuStart = Clock::ThreadCpuTime();
+        auto start = Clock::now();
+        int64_t sampled = 0; // sum of the corrected samples of the individually timed iterations
+        if( m_latency )
+        {
+            result.latency->Clear();
+            for( uint64_t i = 0; i < iterations; i++ )
+            {
+                auto pausedBefore = ::TestKit::__internal_paused_time;
+                uint64_t pausesBefore = ::TestKit::__internal_pauses;
+                auto before = Clock::now();
+                body();
+                auto taken = Clock::now() - before - ( ::TestKit::__internal_paused_time - pausedBefore );
+                int64_t excluded = overhead + (int64_t) ( ::TestKit::__internal_pauses - pausesBefore ) * pauseOverhead;
+                int64_t sample = std::max< int64_t >( std::chrono::duration_cast< std::chrono::nanoseconds >( taken ).count() - excluded, 0 );
+                result.latency->Record( (uint64_t) sample );
+                sampled += sample;
+            }
+        }
+        else
+        {
+            for( uint64_t i = 0; i < iterations; i++ ) { body(); }
+        }
+        auto cpu = Clock::ThreadCpuTime() - cpuStart - ::TestKit::__internal_paused_time;
+        auto excluded = ::TestKit::__internal_paused_time + std::chrono::nanoseconds( ::TestKit::__internal_pauses * pauseOverhead );
+        auto elapsed = std::chrono::duration_cast< std::chrono::nanoseconds >( std::max( Clock::now() - start - excluded, Clock::duration::zero() ) );
+
+        result.iterations = iterations;
+        result.elapsed = elapsed;
+        result.cpu = std::max( cpu, Clock::duration::zero() ); // the paused wall time stands in for the paused cpu time, reading the cpu clock on every pause costs too much
+        if( m_latency && elapsed.count() > 0 )
+        {
+            // the loop also paid for timing and recording every iteration, the corrected samples are what the body took.
+            // the cpu time is scaled down by the same share
+            result.elapsed = std::chrono::nanoseconds( sampled );
+            result.cpu = std::chrono::duration_cast< std::chrono::nanoseconds >( result.cpu * ( (double) sampled / elapsed.count() ) );
+        }
+        if( elapsed >= minimum || iterations >= ( 1ull << 40 ) ) { break; }
+
+        // aim slightly past the target so the next round is usually the last, but never grow more than tenfold at once
+        double scale = elapsed.count() > 0 ? 1.4 * minimum.count() / elapsed.count() : 10.0;
+        iterations = std::max< uint64_t >( iterations + 1, (uint64_t) ( iterations * std::min( scale, 10.0 ) ) );
+    }
+
+    result.itemsPerIteration = ::TestKit::__internal_benchmark_items;
+    result.bytesPerIteration = ::TestKit::__internal_benchmark_bytes;
+    ::TestKit::__internal_benchmark_args.clear();
+    return result;
+}
+
+// ----------------------------------------------------------------------------
+// TestKit Timing Pause implementation
+// ----------------------------------------------------------------------------
+TestKit::TimingPause::TimingPause()
+{
+    PauseTiming();
+}
+
+TestKit::TimingPause::~TimingPause()
+{
+    ResumeTiming();
+}
+
+// ----------------------------------------------------------------------------
+// TestKit Affinity Guard implementation
+// ----------------------------------------------------------------------------
+TestKit::AffinityGuard::AffinityGuard( int slot )
+{
+#if defined( __linux__ )
+    const std::vector< int >& cores = ::TestKit::__internal_curr_options.cores;
+    if( cores.empty() || slot < 0 ) { return; }
+    if( sched_getaffinity( 0, sizeof( m_previous ), &m_previous ) != 0 ) { return; }
+
+    cpu_set_t pinned;
+    CPU_ZERO( &pinned );
+    CPU_SET( cores[slot % cores.size()], &pinned );
+    m_pinned = sched_setaffinity( 0, sizeof( pinned ), &pinned ) == 0; // pid 0 is the calling thread
+#else
+    (void) slot;
+#endif
+}
+
+TestKit::AffinityGuard::~AffinityGuard()
+{
+#if defined( __linux__ )
+    if( m_pinned ) { sched_setaffinity( 0, sizeof( m_previous ), &m_previous ); }
+#endif
+}
+
+// ----------------------------------------------------------------------------
+// TestKit Stress Runner implementation
+// ----------------------------------------------------------------------------
+TestKit::StressRunner::StressRunner( std::string name, int threads, uint64_t iterations, std::source_location source ) :
+    m_name( name ), m_threads( threads ), m_iterations( iterations ), m_source( source ) {}
+
+void TestKit::StressRunner::operator=( std::function< void() > body )
+{
+    UntrackedScope untracked; // the body runs on the worker threads, which are never tracked
+    Segment* segment = ::TestKit::__internal_segment_stack.top()->AddSegment( Segment::BuildAggregate( m_name ) );
+    std::string summary = std::format( "{} threads × {} iterations", m_threads, m_iterations );
+    if( segment->DidFail() )
+    {
+        segment->AddTask( Task::Build( summary, m_source ) );
+        return;
+    }
+    if( m_threads <= 0 )
+    {
+        segment->AddTask( Task::Build( summary + " (needs at least 1 thread)", m_source, false ) );
+        return;
+    }
+
+    struct ThreadStats
+    {
+        uint64_t iterations = 0;    // iterations completed before finishing or bailing out
+        Clock::time_point start;    // when the thread observed the release
+        Clock::time_point end;      // when the thread ran its last iteration
+        bool threw = false;         // did the body throw on this thread?
+    };
+
+    // every thread records into its own segment so checks never race and never add synchronization to the code under test
+    std::vector< Segment > locals( m_threads, Segment::BuildAggregate( m_name ) );
+    std::vector< ThreadStats > stats( m_threads );
+    std::latch release( m_threads ); // blocks instead of spinning, so waiting threads leave the cores to the ones still starting
+    uint64_t seed = ::TestKit::__internal_seed; // every thread gets its own seed, derived from the run's so a failure replays
+
+    std::vector< std::thread > threads;
+    for( int i = 0; i < m_threads; i++ )
+    {
+        threads.emplace_back( [&, i]()
+        {
+            AffinityGuard pin( i );
+            ::TestKit::__internal_thread_index = i;
+            ::TestKit::__internal_seed = ::TestKit::__internal_derive_seed( seed, i );
+            Segment& local = locals[i];
+            ThreadStats& stat = stats[i];
+            ::TestKit::__internal_segment_stack.push( &local );
+
+            release.arrive_and_wait();
+
+            stat.start = Clock::now();
+            try
+            {
+                for( ; stat.iterations < m_iterations && !local.DidFail(); stat.iterations++ ) { body(); }
+            }
+            catch( const std::exception& e )
+            {
+                stat.threw = true;
+                local.AddTask( Task::Build( std::format( "thread {} threw: {}", i, e.what() ), m_source, false ) );
+            }
+            catch( ... )
+            {
+                stat.threw = true;
+                local.AddTask( Task::Build( std::format( "thread {} threw an unknown exception", i ), m_source, false ) );
+            }
+            stat.end = Clock::now();
+
+            ::TestKit::__internal_segment_stack.pop();
+        } );
+    }
+
+    for( std::thread& thread : threads ) { thread.join(); }
+
+    // contention shows up as uneven per-thread throughput and as a skewed start
+    bool threw = false;
+    uint64_t total = 0;
+    double slowest = 0.0;
+    double fastest = 0.0;
+    Clock::time_point firstStart = stats[0].start, lastStart = stats[0].start, lastEnd = stats[0].end;
+    for( int i = 0; i < m_threads; i++ )
+    {
+        const ThreadStats& stat = stats[i];
+        auto elapsed = std::chrono::duration_cast< std::chrono::nanoseconds >( stat.end - stat.start );
+        double rate = elapsed.count() > 0 ? stat.iterations * 1e9 / elapsed.count() : 0.0;
+
+        segment->AddNote( std::format( "thread {}: {} iterations in {} ({})", i, stat.iterations, ReportGenerator::FormatDuration( elapsed ), ReportGenerator::FormatRate( rate ) ) );
+        slowest = i == 0 ? rate : std::min( slowest, rate );
+        fastest = std::max( fastest, rate );
+        firstStart = std::min( firstStart, stat.start );
+        lastStart = std::max( lastStart, stat.start );
+        lastEnd = std::max( lastEnd, stat.end );
+        total += stat.iterations;
+        threw = threw || stat.threw;
+    }
+
+    auto wall = std::chrono::duration_cast< std::chrono::nanoseconds >( lastEnd - firstStart );
+    segment->AddNote( std::format( "total: {} iterations in {} ({}), fairness (slowest / fastest) {:.2f}, start skew {}",
+        total, ReportGenerator::FormatDuration( wall ), ReportGenerator::FormatRate( wall.count() > 0 ? total * 1e9 / wall.count() : 0.0 ),
+        fastest > 0.0 ? slowest / fastest : 1.0, ReportGenerator::FormatDuration( lastStart - firstStart ) ) );
+
+    segment->AddTask( Task::Build( summary, m_source, !threw ) );
+    for( const Segment& local : locals ) { segment->Merge( local ); }
+}
+
+// ----------------------------------------------------------------------------
+// TestKit Fixture implementation
+// ----------------------------------------------------------------------------
+template< typename T >
+TestKit::Fixture< T >::Fixture( std::string name, std::function< T() > builder ) : m_name( name ), m_builder( builder ) {}
+
+template< typename T >
+typename TestKit::Fixture< T >::Handle TestKit::Fixture< T >::Acquire( std::source_location source )
+{
+    UntrackedScope untracked; // the value is shared beyond the section that happens to build it
+    std::lock_guard lock( m_mutex ); // other threads wait here while the value is being built
+    if( !m_value )
+    {
+        Segment segment = Segment::Build( "fixture: " + m_name );
+
+        auto start = Clock::now();
+        m_value = std::make_unique< T >( m_builder() );
+        auto elapsed = Clock::now() - start;
+
+        std::string name = "built in " + ReportGenerator::FormatDuration( elapsed );
+        segment.AddTask( Task::Build( name, source, true ) );
+
+        std::lock_guard fixtureLock( __internal_fixture_mutex );
+        __internal_fixture_segments.push_back( std::move( segment ) );
+    }
+
+    m_active++;
+    return Handle( this, m_value.get() );
+}
+
+template< typename T >
+void TestKit::Fixture< T >::Register( int users )
+{
+    std::lock_guard lock( m_mutex );
+    m_registered += users;
+}
+
+template< typename T >
+void TestKit::Fixture< T >::Release()
+{
+    UntrackedScope untracked;
+    std::lock_guard lock( m_mutex );
+    m_active--;
+    m_finished++;
+
+    // tear down once every registered user is done. unregistered fixtures live as long as the fixture object
+    if( m_active == 0 && m_registered > 0 && m_finished >= m_registered )
+    {
+        m_value.reset();
+        m_registered = 0;
+        m_finished = 0;
+    }
+}
+
+// ----------------------------------------------------------------------------
+// TestKit Async Test implementation
+// ----------------------------------------------------------------------------
+std::coroutine_handle<> TestKit::AsyncTest::promise_type::FinalAwaiter::await_suspend( std::coroutine_handle< promise_type > handle ) noexcept
+{
+    std::coroutine_handle<> continuation = handle.promise().m_continuation;
+    return continuation ? continuation : std::noop_coroutine();
+}
+
+TestKit::AsyncTest::~AsyncTest()
+{
+    if( m_handle ) { m_handle.destroy(); }
+}
+
+std::coroutine_handle<> TestKit::AsyncTest::await_suspend( std::coroutine_handle<> caller ) noexcept
+{
+    m_handle.promise().m_continuation = caller;
+    return m_handle;
+}
+
+void TestKit::AsyncTest::await_resume()
+{
+    if( m_handle.promise().m_exception ) { std::rethrow_exception( m_handle.promise().m_exception ); }
+}
+
+// ----------------------------------------------------------------------------
+// TestKit Async Event implementation
+// ----------------------------------------------------------------------------
+void TestKit::AsyncEvent::await_suspend( std::coroutine_handle<> handle ) const
+{
+    AsyncExecutor* executor = ::TestKit::__internal_executor;
+    assert( executor && "async events can only be awaited by tests run with RUN_ASYNC" );
+
+    switch( type )
+    {
+    case Type::Yield:    executor->Schedule( handle ); break;
+    case Type::Sleep:    executor->ScheduleAt( deadline, handle ); break;
+    case Type::Readable: executor->ScheduleOn( descriptor, false, handle ); break;
+    case Type::Writable: executor->ScheduleOn( descriptor, true, handle ); break;
+    }
+}
+
+// ----------------------------------------------------------------------------
+// TestKit Async Executor implementation
+// ----------------------------------------------------------------------------
+TestKit::AsyncExecutor::AsyncExecutor()
+{
+#if defined( __linux__ )
+    m_epoll = epoll_create1( EPOLL_CLOEXEC );
+#endif
+}
+
+TestKit::AsyncExecutor::~AsyncExecutor()
+{
+#if defined( __linux__ )
+    if( m_epoll >= 0 ) { close( m_epoll ); }
+#endif
+}
+
+void TestKit::AsyncExecutor::Run( std::vector< AsyncTest >& tests, const std::vector< std::string >& names, std::source_location source )
+{
+    assert( !::TestKit::__internal_executor && "await a nested test instead of calling RUN_ASYNC from an async test" );
+
+    // every test gets a segment of its own, named after the expression that created it
+    Segment* top = ::TestKit::__internal_segment_stack.top();
+    const std::string& path = ::TestKit::__internal_section_path;
+    size_t remaining = 0;
+    {
+        UntrackedScope untracked;
+        std::lock_guard< std::mutex > lock( ::TestKit::__internal_async_mutex );
+        for( size_t i = 0; i < tests.size(); i++ )
+        {
+            std::string name = names.size() == tests.size() ? names[i]
+                : names.size() == 1 ? std::format( "{}[{}]", names[0], i ) : std::format( "async test {}", i );
+            m_paths.push_back( path.empty() ? name : path + "/" + name );
+
+            // filtered tests are left out of the report and never started
+            bool enabled = ::TestKit::__internal_section_enabled( m_paths.back() );
+            m_segments.push_back( enabled ? top->AddSegment( Segment::Build( name ) ) : nullptr );
+            if( enabled )
+            {
+                m_ready.push_back( { tests[i].m_handle, i } );
+                remaining++;
+            }
+        }
+    }
+
+    ::TestKit::__internal_executor = this;
+    Clock::time_point start = Clock::now();
+    std::vector< std::optional< Clock::duration > > latencies( tests.size() );
+    while( remaining > 0 )
+    {
+        // resume everything that is ready, coroutines scheduled meanwhile wait for the next turn
+        for( size_t count = m_ready.size(); count > 0 && remaining > 0; count-- )
+        {
+            Waiter waiter = m_ready.front();
+            m_ready.pop_front();
+            Resume( waiter );
+            if( tests[waiter.test].m_handle.done() && !latencies[waiter.test] )
+            {
+                latencies[waiter.test] = Clock::now() - start;
+                remaining--;
+            }
+        }
+
+        Clock::time_point now = Clock::now();
+        while( !m_timers.empty() && m_timers.begin()->first <= now )
+        {
+            m_ready.push_back( m_timers.begin()->second );
+            m_timers.erase( m_timers.begin() );
+        }
+        if( remaining == 0 || !m_ready.empty() ) { continue; }
+
+        // the remaining tests wait on something the loop can't wake them for
+        if( m_timers.empty() && m_descriptors.empty() ) { break; }
+
+        int timeout = -1;
+        if( !m_timers.empty() )
+        {
+            auto wait = std::chrono::ceil< std::chrono::milliseconds >( m_timers.begin()->first - now );
+            timeout = (int) std::min< int64_t >( wait.count(), std::numeric_limits< int >::max() );
+        }
+        Poll( timeout );
+    }
+    ::TestKit::__internal_executor = nullptr;
+
+    UntrackedScope untracked;
+    std::lock_guard< std::mutex > lock( ::TestKit::__internal_async_mutex );
+    for( size_t i = 0; i < tests.size(); i++ )
+    {
+        Segment* segment = m_segments[i];
+        if( !segment ) { continue; }
+
+        if( !latencies[i] )
+        {
+            segment->AddDuration( Clock::now() - start );
+            segment->AddTask( Task::Build( "finished (it waits on something the executor can't wake it for)", source, false ) );
+            continue;
+        }
+
+        segment->AddDuration( *latencies[i] );
+        if( !tests[i].m_handle.promise().m_exception )
+        {
+            segment->AddTask( Task::Build( std::format( "finished (latency {})", ReportGenerator::FormatDuration( *latencies[i] ) ), source, true ) );
+            continue;
+        }
+
+        try
+        {
+            std::rethrow_exception( tests[i].m_handle.promise().m_exception );
+        }
+        catch( const std::exception& e )
+        {
+            segment->AddTask( Task::Build( std::format( "threw: {}", e.what() ), source, false ) );
+        }
+        catch( ... )
+        {
+            segment->AddTask( Task::Build( "threw an unknown exception", source, false ) );
+        }
+    }
+}
+
+void TestKit::AsyncExecutor::Schedule( std::coroutine_handle<> handle )
+{
+    m_ready.push_back( { handle, m_current } );
+}
+
+void TestKit::AsyncExecutor::ScheduleAt( Clock::time_point deadline, std::coroutine_handle<> handle )
+{
+    m_timers.insert( { deadline, Waiter { handle, m_current } } );
+}
+
+void TestKit::AsyncExecutor::ScheduleOn( int descriptor, bool write, std::coroutine_handle<> handle )
+{
+    if( m_epoll < 0 )
+    {
+        Schedule( handle );
+        return;
+    }
+
+    Descriptor& waiting = m_descriptors[descriptor];
+    std::optional< Waiter >& slot = write ? waiting.writer : waiting.reader;
+    assert( !slot && "only one test can wait to read, and one to write, on a descriptor at a time" );
+    slot = Waiter { handle, m_current };
+    Arm( descriptor );
+}
+
+void TestKit::AsyncExecutor::Arm( int descriptor )
+{
+#if defined( __linux__ )
+    Descriptor& waiting = m_descriptors[descriptor];
+    epoll_event event {};
+    event.events = EPOLLONESHOT | ( waiting.reader ? (uint32_t) EPOLLIN : 0 ) | ( waiting.writer ? (uint32_t) EPOLLOUT : 0 );
+    event.data.fd = descriptor;
+    if( epoll_ctl( m_epoll, EPOLL_CTL_MOD, descriptor, &event ) == 0 ) { return; }
+    if( errno == ENOENT && epoll_ctl( m_epoll, EPOLL_CTL_ADD, descriptor, &event ) == 0 ) { return; }
+
+    // epoll refuses descriptors that never block, such as regular files, they are always ready
+    if( waiting.reader ) { m_ready.push_back( *waiting.reader ); }
+    if( waiting.writer ) { m_ready.push_back( *waiting.writer ); }
+    m_descriptors.erase( descriptor );
+#else
+    (void) descriptor;
+#endif
+}
+
+void TestKit::AsyncExecutor::Poll( int timeout )
+{
+#if defined( __linux__ )
+    if( m_descriptors.empty() )
+    {
+        std::this_thread::sleep_for( std::chrono::milliseconds( timeout ) );
+        return;
+    }
+
+    epoll_event events[64];
+    int count = epoll_wait( m_epoll, events, 64, timeout );
+    for( int i = 0; i < count; i++ )
+    {
+        int descriptor = events[i].data.fd;
+        auto found = m_descriptors.find( descriptor );
+        if( found == m_descriptors.end() ) { continue; }
+
+        // errors and hang ups wake both sides, the next read or write reports them
+        Descriptor& waiting = found->second;
+        if( waiting.reader && ( events[i].events & ( EPOLLIN | EPOLLERR | EPOLLHUP ) ) ) { m_ready.push_back( *waiting.reader ); waiting.reader.reset(); }
+        if( waiting.writer && ( events[i].events & ( EPOLLOUT | EPOLLERR | EPOLLHUP ) ) ) { m_ready.push_back( *waiting.writer ); waiting.writer.reset(); }
+
+        if( waiting.reader || waiting.writer ) { Arm( descriptor ); continue; }
+        epoll_ctl( m_epoll, EPOLL_CTL_DEL, descriptor, nullptr );
+        m_descriptors.erase( found );
+    }
+#else
+    std::this_thread::sleep_for( std::chrono::milliseconds( timeout ) );
+#endif
+}
+
+void TestKit::AsyncExecutor::Resume( Waiter waiter )
+{
+    // plain checks and top level coroutine sections made by the test land in its segment
+    std::string& path = ::TestKit::__internal_section_path;
+    std::swap( path, m_paths[waiter.test] );
+    ::TestKit::__internal_segment_stack.push( m_segments[waiter.test] );
+    m_current = waiter.test;
+
+    waiter.handle.resume();
+
+    ::TestKit::__internal_segment_stack.pop();
+    std::swap( path, m_paths[waiter.test] );
+}
+
+// ----------------------------------------------------------------------------
+// TestKit core function implementation
+// ----------------------------------------------------------------------------
+bool TestKit::__internal_section_enabled( const std::string& path )
+{
+    const std::string& filter = __internal_curr_options.sectionFilter;
+    return filter.empty() || path == filter
+        || ( filter.starts_with( path ) && filter[path.size()] == '/' )
+        || ( path.starts_with( filter ) && path[filter.size()] == '/' );
+}
+
+void TestKit::RunAsync( std::vector< AsyncTest > tests, const std::vector< std::string >& names, std::source_location source )
+{
+    AsyncExecutor executor;
+    executor.Run( tests, names, source );
+}
+
+template< typename... Tests >
+std::vector< TestKit::AsyncTest > TestKit::__internal_async_tests( Tests... tests )
+{
+    std::vector< AsyncTest > out;
+    ( out.push_back( std::move( tests ) ), ... );
+    return out;
+}
+
+std::vector< std::string > TestKit::__internal_split_arguments( std::string_view arguments )
+{
+    std::vector< std::string > out;
+    int nesting = 0;
+    char quote = 0;
+    size_t start = 0;
+    for( size_t i = 0; i <= arguments.size(); i++ )
+    {
+        char c = i < arguments.size() ? arguments[i] : ',';
+        if( quote )
+        {
+            if( c == '\\' ) { i++; }
+            else if( c == quote ) { quote = 0; }
+        }
+        else if( c == '"' || c == '\'' ) { quote = c; }
+        else if( c == '(' || c == '[' || c == '{' ) { nesting++; }
+        else if( c == ')' || c == ']' || c == '}' ) { nesting--; }
+        else if( c == ',' && nesting == 0 )
+        {
+            std::string_view argument = arguments.substr( start, i - start );
+            size_t first = argument.find_first_not_of( " \t\n" );
+            size_t last = argument.find_last_not_of( " \t\n" );
+            out.emplace_back( first == std::string_view::npos ? "" : argument.substr( first, last - first + 1 ) );
+            start = i + 1;
+        }
+    }
+    return out;
+}
+
+void TestKit::RegisterTest( std::string name, std::vector< std::string > dependencies, std::function< void() > test, std::source_location source )
+{
+    std::lock_guard lock( __internal_registry_mutex );
+    __internal_registered_tests.push_back( RegisteredTest { std::move( name ), std::move( dependencies ), std::move( test ), source } );
+}
+
+void TestKit::RunRegistered()
+{
+    std::vector< RegisteredTest > tests;
+    {
+        std::lock_guard lock( __internal_registry_mutex );
+        tests = __internal_registered_tests;
+    }
+
+    size_t count = tests.size();
+    std::map< std::string, size_t > indices;
+    for( size_t i = 0; i < count; i++ )
+    {
+        bool unique = indices.emplace( tests[i].name, i ).second;
+        assert( unique && "registered tests must have unique names" );
+        (void) unique;
+    }
+
+    // run the tests the section filter selects along with everything they depend on
+    const std::string path = __internal_section_path;
+    auto pathOf = [&]( size_t i ) { return path.empty() ? tests[i].name : path + "/" + tests[i].name; };
+    std::vector< bool > selected( count, false );
+    std::vector< size_t > pending;
+    for( size_t i = 0; i < count; i++ )
+    {
+        if( __internal_section_enabled( pathOf( i ) ) ) { selected[i] = true; pending.push_back( i ); }
+    }
+    while( !pending.empty() )
+    {
+        size_t i = pending.back();
+        pending.pop_back();
+        for( const std::string& dependency : tests[i].dependencies )
+        {
+            auto found = indices.find( dependency );
+            if( found == indices.end() || selected[found->second] ) { continue; }
+            selected[found->second] = true;
+            pending.push_back( found->second );
+        }
+    }
+
+    // the segments are created up front so the report lists the tests in registration order, whichever finishes first
+    Segment* top = __internal_segment_stack.top();
+    std::vector< Segment* > segments( count, nullptr );
+    std::vector< std::vector< size_t > > dependents( count );
+    std::vector< size_t > waiting( count, 0 );      // prerequisites of each test that haven't finished yet
+    std::vector< std::string > blockedBy( count );  // the first prerequisite of each test that failed or couldn't run
+    std::vector< bool > finished( count, false );
+    std::deque< size_t > ready;
+    {
+        UntrackedScope untracked;
+        for( size_t i = 0; i < count; i++ )
+        {
+            if( !selected[i] ) { continue; }
+            segments[i] = top->AddSegment( Segment::Build( tests[i].name ) );
+            for( const std::string& dependency : tests[i].dependencies )
+            {
+                auto found = indices.find( dependency );
+                if( found == indices.end() )
+                {
+                    segments[i]->AddTask( Task::Build( std::format( "requires '{}', which is not registered", dependency ), tests[i].source, false ) );
+                    segments[i]->MarkFailed();
+                    continue;
+                }
+                dependents[found->second].push_back( i );
+                waiting[i]++;
+            }
+        }
+    }
+
+    // a test that failed, or never ran, blocks everything that depends on it. blocked tests are marked as not run
+    std::function< void( size_t, bool ) > finish = [&]( size_t i, bool failed )
+    {
+        finished[i] = true;
+        for( size_t dependent : dependents[i] )
+        {
+            if( failed && blockedBy[dependent].empty() ) { blockedBy[dependent] = tests[i].name; }
+            if( --waiting[dependent] > 0 ) { continue; }
+            if( segments[dependent]->DidFail() )
+            {
+                finish( dependent, true );
+            }
+            else if( !blockedBy[dependent].empty() )
+            {
+                segments[dependent]->MarkBlocked( blockedBy[dependent], tests[dependent].source );
+                finish( dependent, true );
+            }
+            else
+            {
+                ready.push_back( dependent );
+            }
+        }
+    };
+    for( size_t i = 0; i < count; i++ )
+    {
+        if( !selected[i] || waiting[i] > 0 ) { continue; }
+        if( segments[i]->DidFail() ) { finish( i, true ); }
+        else { ready.push_back( i ); }
+    }
+
+    // runs a test with its segment on top of the stack of the calling thread, reports whether it failed
+    auto execute = [&]( size_t i )
+    {
+        Segment* segment = segments[i];
+        std::string& threadPath = __internal_section_path;
+        std::string outer = std::exchange( threadPath, pathOf( i ) );
+        if( __internal_reporter.Enabled() ) { __internal_reporter.Publish( Event::Make( Event::Type::SectionEnter, Outcome::None, threadPath ) ); }
+        __internal_notify( [&]( Listener* listener ) { listener->OnSectionEnter( threadPath ); } );
+
+        __internal_segment_stack.push( segment );
+        auto start = Clock::now();
+        try
+        {
+            tests[i].test();
+        }
+        catch( const std::exception& e )
+        {
+            segment->AddTask( Task::Build( std::format( "threw: {}", e.what() ), tests[i].source, false ) );
+        }
+        catch( ... )
+        {
+            segment->AddTask( Task::Build( "threw an unknown exception", tests[i].source, false ) );
+        }
+        auto end = Clock::now();
+        __internal_segment_stack.pop();
+
+        UntrackedScope untracked;
+        segment->AddDuration( end - start );
+        Outcome outcome = segment->Check();
+        if( __internal_reporter.Enabled() ) { __internal_reporter.Publish( Event::Make( Event::Type::SectionExit, outcome, threadPath ) ); }
+        __internal_notify( [&]( Listener* listener ) { listener->OnSectionExit( threadPath, outcome, end - start ); } );
+        threadPath = std::move( outer );
+        return outcome == Outcome::Failed;
+    };
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    size_t running = 0;
+    uint64_t seed = __internal_seed;
+    auto worker = [&]()
+    {
+        __internal_seed = seed;
+        std::unique_lock lock( mutex );
+        while( true )
+        {
+            // once nothing is ready or running, whatever is left waits on a dependency cycle
+            changed.wait( lock, [&]() { return !ready.empty() || running == 0; } );
+            if( ready.empty() ) { break; }
+
+            size_t i = ready.front();
+            ready.pop_front();
+            running++;
+            lock.unlock();
+            bool failed = execute( i );
+            lock.lock();
+            running--;
+            finish( i, failed );
+            changed.notify_all();
+        }
+    };
+
+    size_t selectedCount = (size_t) std::count( selected.begin(), selected.end(), true );
+    size_t threadCount = __internal_curr_options.testThreads > 0 ? (size_t) __internal_curr_options.testThreads : std::max( 1u, std::thread::hardware_concurrency() );
+    threadCount = std::max< size_t >( 1, std::min( threadCount, selectedCount ) );
+    std::vector< std::thread > threads;
+    for( size_t i = 1; i < threadCount; i++ ) { threads.emplace_back( worker ); }
+    worker();
+    for( std::thread& thread : threads ) { thread.join(); }
+
+    UntrackedScope untracked;
+    for( size_t i = 0; i < count; i++ )
+    {
+        if( !selected[i] || finished[i] ) { continue; }
+        segments[i]->AddTask( Task::Build( "never ran, its dependencies form a cycle", tests[i].source, false ) );
+    }
+}
+
+TestKit::AsyncEvent TestKit::Readable( int descriptor ) { return AsyncEvent { .type = AsyncEvent::Type::Readable, .descriptor = descriptor }; }
+TestKit::AsyncEvent TestKit::Writable( int descriptor ) { return AsyncEvent { .type = AsyncEvent::Type::Writable, .descriptor = descriptor }; }
+TestKit::AsyncEvent TestKit::Sleep( std::chrono::nanoseconds duration ) { return AsyncEvent { .type = AsyncEvent::Type::Sleep, .deadline = Clock::now() + duration }; }
+TestKit::AsyncEvent TestKit::Yield() { return AsyncEvent { .type = AsyncEvent::Type::Yield }; }
+
+void TestKit::AddListener( Listener* listener )
+{
+    std::unique_lock lock( __internal_listener_mutex );
+    __internal_listeners.push_back( listener );
+    __internal_has_listeners = true;
+}
+
+void TestKit::RemoveListener( Listener* listener )
+{
+    std::unique_lock lock( __internal_listener_mutex );
+    std::erase( __internal_listeners, listener );
+    __internal_has_listeners = !__internal_listeners.empty();
+}
+
+template< typename Callback >
+void TestKit::__internal_notify( Callback callback )
+{
+#if !defined( TESTKIT_DISABLE_LISTENERS )
+    if( !__internal_has_listeners.load( std::memory_order_relaxed ) ) { return; }
+    std::shared_lock lock( __internal_listener_mutex );
+    for( Listener* listener : __internal_listeners ) { callback( listener ); }
+#else
+    (void) callback;
+#endif
+}
+
+void TestKit::SetNewOptions( Options newOptions )
+{
+    __internal_curr_options = newOptions;
+    __internal_reporter.Start( newOptions );
+}
+
+void TestKit::Reset()
+{
+    __internal_root.m_didFail = false;
+    __internal_root.m_nodes.clear();
+    __internal_root.m_segments.clear();
+    __internal_root.m_tasks.clear();
+    while( __internal_segment_stack.size() > 0 )
+    {
+        __internal_segment_stack.pop();
+    }
+    __internal_segment_stack.push( &__internal_root );
+
+    __internal_noisy_benchmarks = 0;
+    __internal_pinning_noted = false;
+
+    std::lock_guard lock( __internal_fixture_mutex );
+    __internal_fixture_segments.clear();
+}
+
+uint64_t TestKit::__internal_derive_seed( uint64_t base, uint64_t stream )
+{
+    if( stream == 0 ) { return base; }
+
+    // splitmix64
+    uint64_t seed = base + stream * 0x9e3779b97f4a7c15ull;
+    seed = ( seed ^ ( seed >> 30 ) ) * 0xbf58476d1ce4e5b9ull;
+    seed = ( seed ^ ( seed >> 27 ) ) * 0x94d049bb133111ebull;
+    return seed ^ ( seed >> 31 );
+}
+
+void TestKit::Run( std::function< void() > tests, std::source_location source )
+{
+    Options options = __internal_curr_options;
+    uint64_t base = options.seed;
+    if( base == 0 )
+    {
+        std::random_device device;
+        base = ( (uint64_t) device() << 32 ) | device();
+    }
+
+    if( options.repeat <= 1 )
+    {
+        __internal_seed = base;
+        __internal_notify( [&]( Listener* listener ) { listener->OnRunStart( 0, base ); } );
+        tests();
+        __internal_notify( [&]( Listener* listener ) { listener->OnRunEnd( 0, __internal_segment_stack.top()->Check() ); } );
+        return;
+    }
+
+    // every run records into its own segment which is then folded into a shared aggregate, so the report lists how often each check failed
+    Segment* segment = __internal_segment_stack.top()->AddSegment( Segment::BuildAggregate( "repeated runs" ) );
+    std::atomic< uint64_t > next = 0;
+    std::atomic< bool > stop = false;
+    std::mutex mutex;
+    uint64_t completed = 0;
+    uint64_t failed = 0;
+    uint64_t firstFailure = UINT64_MAX;
+    uint64_t firstFailureSeed = 0;
+
+    auto worker = [&]()
+    {
+        while( !stop.load( std::memory_order_relaxed ) )
+        {
+            uint64_t run = next.fetch_add( 1 );
+            if( run >= (uint64_t) options.repeat ) { break; }
+
+            // the first run uses the base seed directly so a failing seed can be replayed with a single run
+            uint64_t seed = __internal_derive_seed( base, run );
+
+            Segment local = Segment::Build( "" );
+            __internal_seed = seed;
+            __internal_notify( [&]( Listener* listener ) { listener->OnRunStart( run, seed ); } );
+            __internal_segment_stack.push( &local );
+            try
+            {
+                tests();
+            }
+            catch( const std::exception& e )
+            {
+                local.AddTask( Task::Build( std::format( "run threw: {}", e.what() ), source, false ) );
+            }
+            catch( ... )
+            {
+                local.AddTask( Task::Build( "run threw an unknown exception", source, false ) );
+            }
+            __internal_segment_stack.pop();
+            __internal_notify( [&]( Listener* listener ) { listener->OnRunEnd( run, local.Check() ); } );
+
+            std::lock_guard lock( mutex );
+            segment->Merge( local );
+            completed++;
+            if( local.Check() == Outcome::Failed )
+            {
+                failed++;
+                if( run < firstFailure ) { firstFailure = run; firstFailureSeed = seed; }
+                if( options.repeatUntilFail ) { stop.store( true, std::memory_order_relaxed ); }
+            }
+        }
+    };
+
+    std::vector< std::thread > threads;
+    for( int i = 1; i < options.repeatThreads; i++ ) { threads.emplace_back( worker ); }
+    worker();
+    for( std::thread& thread : threads ) { thread.join(); }
+
+    segment->AddNote( std::format( "{} of {} runs completed, {} failed ({:.3g}%), base seed 0x{:x}",
+        completed, options.repeat, failed, completed > 0 ? 100.0 * failed / completed : 0.0, base ) );
+    if( failed > 0 )
+    {
+        segment->AddNote( std::format( "first failure in run {}, replay it with a single run seeded with 0x{:x}", firstFailure, firstFailureSeed ) );
+    }
+}
+
+void TestKit::CheckComplexity( const std::vector< int64_t >& sizes, std::function< void( int64_t ) > fn, Complexity expected, std::source_location source )
+{
+    constexpr const char* names[] = { "O(1)", "O(log n)", "O(n)", "O(n log n)", "O(n^2)", "O(n^3)" };
+    auto growth = []( Complexity complexity, double n )
+    {
+        switch( complexity )
+        {
+            case Complexity::O_1:           return 1.0;
+            case Complexity::O_LOG_N:       return std::log2( n );
+            case Complexity::O_N:           return n;
+            case Complexity::O_N_LOG_N:     return n * std::log2( n );
+            case Complexity::O_N_SQUARED:   return n * n;
+            case Complexity::O_N_CUBED:     return n * n * n;
+        }
+        return 1.0;
+    };
+
+    Segment* top = __internal_segment_stack.top();
+    std::string name = std::format( "grows no faster than {}", names[(int) expected] );
+    if( top->DidFail() )
+    {
+        top->AddTask( Task::Build( name, source ) );
+        return;
+    }
+    if( sizes.size() < 3 ) // three sizes is the least that can tell growth classes apart
+    {
+        top->AddTask( Task::Build( name + " (needs at least 3 sizes)", source, false ) );
+        return;
+    }
+
+    std::vector< double > times;
+    double mean = 0.0;
+    for( int64_t size : sizes )
+    {
+        times.push_back( (double) Measure::Median( [&]() { fn( size ); } ).count() );
+        mean += times.back() / sizes.size();
+    }
+
+    // least squares fit of time = coefficient * growth( n ) for every class, scored by the rms error relative to the mean time
+    double errors[std::size( names )];
+    int best = 0;
+    for( int c = 0; c < (int) std::size( names ); c++ )
+    {
+        double numerator = 0.0, denominator = 0.0;
+        for( size_t i = 0; i < sizes.size(); i++ )
+        {
+            double g = growth( (Complexity) c, (double) sizes[i] );
+            numerator += times[i] * g;
+            denominator += g * g;
+        }
+        double coefficient = denominator > 0.0 ? numerator / denominator : 0.0;
+
+        double squares = 0.0;
+        for( size_t i = 0; i < sizes.size(); i++ )
+        {
+            double residual = times[i] - coefficient * growth( (Complexity) c, (double) sizes[i] );
+            squares += residual * residual;
+        }
+        errors[c] = mean > 0.0 ? std::sqrt( squares / sizes.size() ) / mean : 0.0;
+        if( errors[c] < errors[best] ) { best = c; }
+    }
+
+    // noise makes neighbouring classes fit almost equally well, only a clearly better fit of a worse class fails
+    bool worse = best > (int) expected && errors[best] * 2.0 < errors[(int) expected];
+    name += std::format( " (best fit {}, rms {:.1f}% against {:.1f}%)", names[best], 100.0 * errors[best], 100.0 * errors[(int) expected] );
+    top->AddTask( Task::Build( name, source, !worse ) );
+}
+
+std::string TestKit::GenerateReport()
+{
+    // attach the fixture segments that were built since the last report
+    {
+        std::lock_guard lock( __internal_fixture_mutex );
+        for( Segment& segment : __internal_fixture_segments )
+        {
+            __internal_root.AddSegment( std::move( segment ) );
+        }
+        __internal_fixture_segments.clear();
+    }
+
+    std::string report = ReportGenerator::Stringify( &__internal_root, -1 );
+    report = report.substr( report.find_first_not_of( "\n" ) );
+
+    if( !__internal_curr_options.historyFile.empty() )
+    {
+        std::string history = ReportGenerator::StringifyHistory( LoadHistory( __internal_curr_options.historyFile ) );
+        if( !history.empty() ) { report += "\n\n" + history + "\n"; }
+    }
+    return report;
+}
+
+// History file layout, in host byte order: a "TKH1" magic followed by one record per section per run
+//   u64 run id | i64 duration in ns | u8 outcome | u16 path length | path bytes
+void TestKit::RecordHistory()
+{
+    const std::string& file = __internal_curr_options.historyFile;
+    if( file.empty() ) { return; }
+
+    bool fresh = !std::ifstream( file, std::ios::binary ).good();
+    std::ofstream out( file, std::ios::binary | std::ios::app );
+    if( !out ) { return; }
+    if( fresh ) { out.write( "TKH1", 4 ); }
+
+    uint64_t run = (uint64_t) std::chrono::system_clock::now().time_since_epoch().count();
+    auto write = [&]( auto& self, const Segment& segment, const std::string& path ) -> void
+    {
+        for( const Segment& child : segment.m_segments )
+        {
+            std::string childPath = path.empty() ? child.m_name : path + "/" + child.m_name;
+            int64_t duration = child.m_duration.count();
+            uint8_t outcome = (uint8_t) child.Check();
+            uint16_t length = (uint16_t) std::min< size_t >( childPath.size(), SectionHistory::MaxPathLength );
+
+            out.write( (const char*) &run, sizeof( run ) );
+            out.write( (const char*) &duration, sizeof( duration ) );
+            out.write( (const char*) &outcome, sizeof( outcome ) );
+            out.write( (const char*) &length, sizeof( length ) );
+            out.write( childPath.data(), length );
+            self( self, child, childPath );
+        }
+    };
+    write( write, __internal_root, "" );
+}
+
+void TestKit::CompareBenchmarks( std::string name, std::function< void() > a, std::function< void() > b, std::source_location source )
+{
+    constexpr int samples = 30; // per implementation
+    Segment* segment = __internal_segment_stack.top()->AddSegment( Segment::BuildAggregate( name ) );
+    if( segment->DidFail() )
+    {
+        segment->AddTask( Task::Build( "b is not slower than a", source ) );
+        return;
+    }
+
+    AffinityGuard pin( 0 );
+    __internal_warn_noise( segment );
+
+    // size the batches so that both implementations together fill the benchmark time
+    auto target = std::chrono::duration_cast< std::chrono::nanoseconds >( __internal_curr_options.benchmarkTime ) / ( 2 * samples );
+    auto calibrate = [&]( const std::function< void() >& block )
+    {
+        uint64_t batch = 1;
+        while( batch < ( 1ull << 30 ) )
+        {
+            auto start = Clock::now();
+            for( uint64_t i = 0; i < batch; i++ ) { block(); }
+            auto elapsed = Clock::now() - start;
+            if( elapsed >= target ) { break; }
+            batch *= elapsed.count() > 0 ? std::clamp< uint64_t >( target / elapsed, 2, 100 ) : 100;
+        }
+        return batch;
+    };
+    uint64_t batches[2] = { calibrate( a ), calibrate( b ) };
+
+    // random interleaving spreads thermal and frequency drift evenly over both implementations
+    std::vector< int > order( 2 * samples );
+    for( int i = 0; i < 2 * samples; i++ ) { order[i] = i % 2; }
+    std::mt19937_64 rng( __internal_seed ); // the run's seed, so the order of a failed comparison can be replayed
+    std::shuffle( order.begin(), order.end(), rng );
+
+    std::vector< double > times[2];
+    for( int which : order )
+    {
+        const std::function< void() >& block = which == 0 ? a : b;
+        auto start = Clock::now();
+        for( uint64_t i = 0; i < batches[which]; i++ ) { block(); }
+        times[which].push_back( (double) ( Clock::now() - start ).count() / batches[which] );
+    }
+
+    auto median = []( std::vector< double > values )
+    {
+        std::sort( values.begin(), values.end() );
+        return ( values[( values.size() - 1 ) / 2] + values[values.size() / 2] ) / 2.0;
+    };
+    double medians[2] = { median( times[0] ), median( times[1] ) };
+    double ratio = medians[0] > 0.0 ? medians[1] / medians[0] : 1.0;
+
+    // 95% confidence interval of the ratio of medians by bootstrap resampling
+    std::vector< double > ratios;
+    for( int r = 0; r < 1000; r++ )
+    {
+        std::vector< double > resampled[2];
+        for( int which = 0; which < 2; which++ )
+        {
+            std::uniform_int_distribution< size_t > pick( 0, times[which].size() - 1 );
+            for( size_t i = 0; i < times[which].size(); i++ ) { resampled[which].push_back( times[which][pick( rng )] ); }
+        }
+        double base = median( resampled[0] );
+        ratios.push_back( base > 0.0 ? median( resampled[1] ) / base : 1.0 );
+    }
+    std::sort( ratios.begin(), ratios.end() );
+    double low = ratios[25], high = ratios[974];
+
+    // two sided Mann-Whitney U test using the normal approximation, ties share their average rank
+    std::vector< std::pair< double, int > > ranked;
+    for( int which = 0; which < 2; which++ )
+    {
+        for( double time : times[which] ) { ranked.push_back( { time, which } ); }
+    }
+    std::sort( ranked.begin(), ranked.end() );
+    double rankSumB = 0.0;
+    for( size_t i = 0; i < ranked.size(); )
+    {
+        size_t j = i;
+        while( j < ranked.size() && ranked[j].first == ranked[i].first ) { j++; }
+        double rank = ( i + 1 + j ) / 2.0;
+        for( size_t k = i; k < j; k++ ) { rankSumB += ranked[k].second == 1 ? rank : 0.0; }
+        i = j;
+    }
+    double n = samples;
+    double u = rankSumB - n * ( n + 1 ) / 2.0;
+    double z = ( u - n * n / 2.0 ) / std::sqrt( n * n * ( 2 * n + 1 ) / 12.0 );
+    double p = std::erfc( std::abs( z ) / std::sqrt( 2.0 ) );
+
+    segment->AddNote( std::format( "a: median {} per call over {} samples", ReportGenerator::FormatDuration( std::chrono::duration< double, std::nano >( medians[0] ) ), samples ) );
+    segment->AddNote( std::format( "b: median {} per call over {} samples", ReportGenerator::FormatDuration( std::chrono::duration< double, std::nano >( medians[1] ) ), samples ) );
+
+    // a difference needs both a significant test and an interval that leaves out 1, the verdict names the same difference the check fails on
+    bool significant = p < __internal_curr_options.significance;
+    bool slower = significant && low > 1.0;
+    bool faster = significant && high < 1.0;
+    std::string verdict = slower ? "b is slower" : faster ? "b is faster" : "no significant difference";
+    segment->AddTask( Task::Build( std::format( "b is not slower than a (time ratio b / a {:.3f}, 95% CI [{:.3f}, {:.3f}], p = {:.2g}, {})", ratio, low, high, p, verdict ), source, !slower ) );
+}
+
+std::vector< std::string > TestKit::DetectBenchmarkNoise()
+{
+    std::vector< std::string > warnings;
+#if defined( __linux__ )
+    auto read = []( std::string path )
+    {
+        std::string value;
+        std::ifstream( path ) >> value;
+        return value;
+    };
+
+    cpu_set_t affinity;
+    CPU_ZERO( &affinity );
+    int allowed = 0;
+    if( sched_getaffinity( 0, sizeof( affinity ), &affinity ) == 0 ) { allowed = CPU_COUNT( &affinity ); }
+
+    // only the cpus this thread may run on matter
+    std::map< std::string, int > governors;
+    for( int cpu = 0; cpu < CPU_SETSIZE && allowed > 0; cpu++ )
+    {
+        if( !CPU_ISSET( cpu, &affinity ) ) { continue; }
+        std::string governor = read( std::format( "/sys/devices/system/cpu/cpu{}/cpufreq/scaling_governor", cpu ) );
+        if( !governor.empty() && governor != "performance" ) { governors[governor]++; }
+    }
+    for( const auto& [governor, count] : governors )
+    {
+        warnings.push_back( std::format( "{} cpus use the '{}' frequency governor instead of 'performance'", count, governor ) );
+    }
+
+    if( read( "/sys/devices/system/cpu/intel_pstate/no_turbo" ) == "0" || read( "/sys/devices/system/cpu/cpufreq/boost" ) == "1" )
+    {
+        warnings.push_back( "turbo boost is enabled, clock speeds depend on temperature and load" );
+    }
+
+    double load = 0.0;
+    std::ifstream( "/proc/loadavg" ) >> load;
+    unsigned int cores = std::max( 1u, std::thread::hardware_concurrency() );
+    if( load > 1.0 + 0.1 * cores ) // the benchmark itself accounts for one
+    {
+        warnings.push_back( std::format( "load average is {:.2f} on {} cores, other processes compete for the cpu", load, cores ) );
+    }
+#endif
+    return warnings;
+}
+
+void TestKit::PauseTiming()
+{
+    if( __internal_timing_paused ) { return; }
+    __internal_timing_paused = true;
+    __internal_pause_start = Clock::now();
+}
+
+void TestKit::ResumeTiming()
+{
+    if( !__internal_timing_paused ) { return; }
+    __internal_paused_time += Clock::now() - __internal_pause_start;
+    __internal_pauses++;
+    __internal_timing_paused = false;
+}
+
+std::vector< uint64_t > TestKit::CacheSizes()
+{
+    std::vector< uint64_t > sizes = { 0, 0, 0 };
+#if defined( __linux__ ) && defined( _SC_LEVEL1_DCACHE_SIZE )
+    int names[] = { _SC_LEVEL1_DCACHE_SIZE, _SC_LEVEL2_CACHE_SIZE, _SC_LEVEL3_CACHE_SIZE };
+    for( size_t i = 0; i < sizes.size(); i++ ) { sizes[i] = (uint64_t) std::max( sysconf( names[i] ), 0l ); } // -1 or 0 when the level is unknown
+#endif
+    return sizes;
+}
+
+void TestKit::__internal_warn_noise( Segment* segment )
+{
+    if( !__internal_curr_options.detectNoise ) { return; }
+
+    std::vector< std::string > warnings = DetectBenchmarkNoise();
+    for( const std::string& warning : warnings ) { segment->AddNote( "⚠ " + warning ); }
+    if( !warnings.empty() ) { __internal_noisy_benchmarks++; }
+
+#if defined( __linux__ )
+    // most benchmarks run unpinned, which is worth knowing but doesn't make the machine noisy. pointed out once
+    cpu_set_t affinity;
+    CPU_ZERO( &affinity );
+    if( sched_getaffinity( 0, sizeof( affinity ), &affinity ) == 0 && CPU_COUNT( &affinity ) > 1 && !__internal_pinning_noted.exchange( true ) )
+    {
+        segment->AddNote( std::format( "not pinned, the scheduler may migrate benchmarks across {} cpus, set Options::cores to pin them", CPU_COUNT( &affinity ) ) );
+    }
+#endif
+}
+
+// Baseline file layout: a commented header followed by one tab separated line per benchmark
+//   name | iterations | ns per iteration | items per second | bytes per second
+bool TestKit::SaveBaseline( std::string path )
+{
+    if( __internal_curr_options.refuseNoisyBaselines && __internal_noisy_benchmarks > 0 ) { return false; } // a noisy baseline would flag phantom regressions
+
+    std::ofstream out( path, std::ios::trunc );
+    if( !out ) { return false; }
+    out << "# name\titerations\tns_per_iteration\titems_per_second\tbytes_per_second\n";
+
+    auto write = [&]( auto& self, const Segment& segment, const std::string& name ) -> void
+    {
+        if( segment.m_benchmark )
+        {
+            const BenchmarkResult& result = *segment.m_benchmark;
+            out << std::format( "{}\t{}\t{:.3f}\t{:.3f}\t{:.3f}\n", name, result.iterations, result.NanosecondsPerIteration(), result.ItemsPerSecond(), result.BytesPerSecond() );
+        }
+        for( const Segment& child : segment.m_segments )
+        {
+            self( self, child, name.empty() ? child.m_name : name + "/" + child.m_name );
+        }
+    };
+    write( write, __internal_root, "" );
+    return out.good();
+}
+
+// Follows the json layout of Google Benchmark's --benchmark_format=json, so its compare.py and dashboards read it as is. Latency
+// percentiles are written as user counters, which Google Benchmark flattens into the benchmark object as well
+bool TestKit::ExportBenchmarkJson( std::string path )
+{
+    std::ofstream out( path, std::ios::trunc );
+    if( !out ) { return false; }
+
+    auto escape = []( const std::string& text )
+    {
+        std::string escaped;
+        for( char c : text )
+        {
+            if( c == '"' || c == '\\' ) { escaped += '\\'; escaped += c; }
+            else if( (unsigned char) c < 0x20 ) { escaped += std::format( "\\u{:04x}", (int) c ); }
+            else { escaped += c; }
+        }
+        return escaped;
+    };
+
+    char date[64] = {};
+    std::time_t now = std::time( nullptr );
+    std::strftime( date, sizeof( date ), "%Y-%m-%dT%H:%M:%S%z", std::localtime( &now ) );
+
+    std::vector< std::string > caches;
+    std::vector< uint64_t > sizes = CacheSizes();
+    for( size_t i = 0; i < sizes.size(); i++ )
+    {
+        if( sizes[i] == 0 ) { continue; }
+        caches.push_back( std::format( "{{ \"type\": \"{}\", \"level\": {}, \"size\": {}, \"num_sharing\": 0 }}", i == 0 ? "Data" : "Unified", i + 1, sizes[i] ) );
+    }
+
+    out << "{\n  \"context\": {\n";
+    out << std::format( "    \"date\": \"{}\",\n", date );
+    out << std::format( "    \"num_cpus\": {},\n", std::thread::hardware_concurrency() );
+    out << "    \"caches\": [";
+    for( size_t i = 0; i < caches.size(); i++ ) { out << ( i == 0 ? "\n      " : ",\n      " ) << caches[i]; }
+    out << ( caches.empty() ? "],\n" : "\n    ],\n" );
+#if defined( NDEBUG )
+    out << "    \"library_build_type\": \"release\"\n";
+#else
+    out << "    \"library_build_type\": \"debug\"\n";
+#endif
+    out << "  },\n  \"benchmarks\": [";
+
+    bool first = true;
+    auto write = [&]( auto& self, const Segment& segment, const std::string& name ) -> void
+    {
+        if( segment.m_benchmark )
+        {
+            const BenchmarkResult& result = *segment.m_benchmark;
+            out << ( first ? "\n" : ",\n" ) << "    {\n";
+            out << std::format( "      \"name\": \"{}\",\n", escape( name ) );
+            out << std::format( "      \"run_name\": \"{}\",\n", escape( name ) );
+            out << "      \"run_type\": \"iteration\",\n      \"repetitions\": 1,\n      \"repetition_index\": 0,\n";
+            out << std::format( "      \"threads\": {},\n", result.threads );
+            out << std::format( "      \"iterations\": {},\n", result.iterations );
+            out << std::format( "      \"real_time\": {},\n", result.NanosecondsPerIteration() );
+            out << std::format( "      \"cpu_time\": {},\n", result.CpuNanosecondsPerIteration() );
+            out << "      \"time_unit\": \"ns\"";
+            if( result.itemsPerIteration > 0 ) { out << std::format( ",\n      \"items_per_second\": {}", result.ItemsPerSecond() ); }
+            if( result.bytesPerIteration > 0 ) { out << std::format( ",\n      \"bytes_per_second\": {}", result.BytesPerSecond() ); }
+            if( result.latency )
+            {
+                for( auto [counter, percentile] : { std::pair( "p50", 50.0 ), { "p90", 90.0 }, { "p99", 99.0 }, { "p99.9", 99.9 } } )
+                {
+                    out << std::format( ",\n      \"{}\": {}", counter, result.latency->Percentile( percentile ) );
+                }
+                out << std::format( ",\n      \"max\": {}", result.latency->Max() );
+            }
+            out << "\n    }";
+            first = false;
+        }
+        for( const Segment& child : segment.m_segments )
+        {
+            self( self, child, name.empty() ? child.m_name : name + "/" + child.m_name );
+        }
+    };
+    write( write, __internal_root, "" );
+    out << ( first ? "]\n}\n" : "\n  ]\n}\n" );
+    return out.good();
+}
+
+std::vector< TestKit::SectionHistory > TestKit::LoadHistory( std::string path )
+{
+    std::vector< SectionHistory > history;
+    std::ifstream in( path, std::ios::binary );
+    char magic[4] = {};
+    if( !in.read( magic, 4 ) || std::string_view( magic, 4 ) != "TKH1" ) { return history; }
+
+    std::map< std::string, size_t > index;      // section path to its position in the history
+    std::map< std::string, Outcome > previous;  // last pass or fail seen for a section
+    while( in )
+    {
+        uint64_t run = 0;
+        int64_t duration = 0;
+        uint8_t outcome = 0;
+        uint16_t length = 0;
+        in.read( (char*) &run, sizeof( run ) );
+        in.read( (char*) &duration, sizeof( duration ) );
+        in.read( (char*) &outcome, sizeof( outcome ) );
+        in.read( (char*) &length, sizeof( length ) );
+
+        // a truncated trailing record from an interrupted run ends the history, so does anything that can't be a record
+        if( !in || outcome > (uint8_t) Outcome::Passed || length > SectionHistory::MaxPathLength ) { break; }
+        std::string sectionPath( length, '\0' );
+        if( !in.read( sectionPath.data(), length ) ) { break; }
+
+        Outcome result = (Outcome) outcome;
+        if( result == Outcome::None ) { continue; }
+
+        auto [entry, inserted] = index.try_emplace( sectionPath, history.size() );
+        if( inserted ) { history.emplace_back().path = sectionPath; }
+
+        SectionHistory& section = history[entry->second];
+        section.runs++;
+        section.failures += result == Outcome::Failed ? 1 : 0;
+        section.durations.push_back( duration );
+
+        auto [last, first] = previous.try_emplace( sectionPath, result );
+        if( !first && last->second != result ) { section.flips++; }
+        last->second = result;
+    }
+    return history;
+}
+
+#if defined( TESTKIT_TRACK_ALLOCATIONS )
+// ----------------------------------------------------------------------------
+// TestKit allocation hooks
+// ----------------------------------------------------------------------------
+void* TestKit::__internal_allocate( size_t size, size_t alignment, void* site )
+{
+    // the header sits right in front of the aligned block, so it is found again from the pointer alone
+    alignment = std::max< size_t >( alignment, __STDCPP_DEFAULT_NEW_ALIGNMENT__ );
+    void* raw = std::malloc( sizeof( AllocationHeader ) + size + alignment );
+    if( raw == nullptr ) { return nullptr; }
+    uintptr_t block = ( (uintptr_t) raw + sizeof( AllocationHeader ) + alignment - 1 ) & ~( (uintptr_t) alignment - 1 );
+    AllocationHeader* header = new( (AllocationHeader*) block - 1 ) AllocationHeader();
+    header->m_size = size;
+    header->m_raw = raw;
+
+    AllocationTracker* tracker = __internal_allocation_tracker;
+    if( tracker == nullptr || __internal_untracked > 0 ) { return (void*) block; }
+    tracker->m_balance += (int64_t) size;
+    tracker->m_peak = std::max( tracker->m_peak, tracker->m_balance );
+
+#if defined( __linux__ )
+    int depth = __internal_curr_options.allocationBacktraceDepth;
+    if( depth > 0 && __internal_allocation_samples++ % (uint64_t) std::max( __internal_curr_options.allocationSampleRate, 1 ) == 0 )
+    {
+        // backtrace() may allocate on its first use, which must not be tracked or recurse into sampling
+        UntrackedScope untracked;
+        // the hooks are dropped by finding operator new's return address, how many frames they take
+        // depends on inlining and tail calls, when it is not found only this function's frame is dropped
+        constexpr int slack = 4;
+        void* frames[128 + slack];
+        int captured = backtrace( frames, std::min( depth, 128 ) + slack );
+        int skipped = (int) ( std::find( frames, frames + captured, site ) - frames );
+        if( skipped == captured ) { skipped = std::min( captured, 1 ); }
+        int kept = std::min( captured - skipped, depth );
+        if( kept > 0 && ( header->m_frames = (void**) std::malloc( sizeof( void* ) * kept ) ) )
+        {
+            std::copy( frames + skipped, frames + skipped + kept, header->m_frames );
+            header->m_depth = kept;
+        }
+    }
+#else
+    (void) site;
+#endif
+
+    std::lock_guard lock( __internal_allocation_mutex );
+    tracker->Link( header );
+    return (void*) block;
+}
+
+void TestKit::__internal_deallocate( void* pointer )
+{
+    if( pointer == nullptr ) { return; }
+    AllocationHeader* header = (AllocationHeader*) pointer - 1;
+
+    // only allocations live in some tracker need the lock, and the tracker may only change while it is held
+    if( header->m_tracker.load( std::memory_order_relaxed ) != nullptr )
+    {
+        std::lock_guard lock( __internal_allocation_mutex );
+        if( AllocationTracker* owner = header->m_tracker.load( std::memory_order_relaxed ) ) { owner->Unlink( header ); }
+    }
+    if( __internal_allocation_tracker != nullptr && __internal_untracked == 0 ) { __internal_allocation_tracker->m_balance -= (int64_t) header->m_size; }
+
+    std::free( header->m_frames );
+    std::free( header->m_raw );
+}
+
+// operator new stays out of line so its return address is the allocating line, which is where sampled backtraces start
+#if defined( __GNUC__ )
+#define __INTERNAL_TK_NOINLINE __attribute__(( noinline ))
+#define __INTERNAL_TK_NEW_SITE __builtin_return_address( 0 )
+#else
+#define __INTERNAL_TK_NOINLINE __declspec( noinline )
+#define __INTERNAL_TK_NEW_SITE nullptr
+#endif
+
+__INTERNAL_TK_NOINLINE void* operator new( std::size_t size )
+{
+    if( void* pointer = TestKit::__internal_allocate( size, 0, __INTERNAL_TK_NEW_SITE ) ) { return pointer; }
+    throw std::bad_alloc();
+}
+
+__INTERNAL_TK_NOINLINE void* operator new[]( std::size_t size )
+{
+    if( void* pointer = TestKit::__internal_allocate( size, 0, __INTERNAL_TK_NEW_SITE ) ) { return pointer; }
+    throw std::bad_alloc();
+}
+
+__INTERNAL_TK_NOINLINE void* operator new( std::size_t size, std::align_val_t alignment )
+{
+    if( void* pointer = TestKit::__internal_allocate( size, (size_t) alignment, __INTERNAL_TK_NEW_SITE ) ) { return pointer; }
+    throw std::bad_alloc();
+}
+
+__INTERNAL_TK_NOINLINE void* operator new[]( std::size_t size, std::align_val_t alignment )
+{
+    if( void* pointer = TestKit::__internal_allocate( size, (size_t) alignment, __INTERNAL_TK_NEW_SITE ) ) { return pointer; }
+    throw std::bad_alloc();
+}
+
+__INTERNAL_TK_NOINLINE void* operator new( std::size_t size, const std::nothrow_t& ) noexcept { return TestKit::__internal_allocate( size, 0, __INTERNAL_TK_NEW_SITE ); }
+__INTERNAL_TK_NOINLINE void* operator new[]( std::size_t size, const std::nothrow_t& ) noexcept { return TestKit::__internal_allocate( size, 0, __INTERNAL_TK_NEW_SITE ); }
+__INTERNAL_TK_NOINLINE void* operator new( std::size_t size, std::align_val_t alignment, const std::nothrow_t& ) noexcept { return TestKit::__internal_allocate( size, (size_t) alignment, __INTERNAL_TK_NEW_SITE ); }
+__INTERNAL_TK_NOINLINE void* operator new[]( std::size_t size, std::align_val_t alignment, const std::nothrow_t& ) noexcept { return TestKit::__internal_allocate( size, (size_t) alignment, __INTERNAL_TK_NEW_SITE ); }
+
+void operator delete( void* pointer ) noexcept { TestKit::__internal_deallocate( pointer ); }
+void operator delete[]( void* pointer ) noexcept { TestKit::__internal_deallocate( pointer ); }
+void operator delete( void* pointer, std::size_t ) noexcept { TestKit::__internal_deallocate( pointer ); }
+void operator delete[]( void* pointer, std::size_t ) noexcept { TestKit::__internal_deallocate( pointer ); }
+void operator delete( void* pointer, std::align_val_t ) noexcept { TestKit::__internal_deallocate( pointer ); }
+void operator delete[]( void* pointer, std::align_val_t ) noexcept { TestKit::__internal_deallocate( pointer ); }
+void operator delete( void* pointer, std::size_t, std::align_val_t ) noexcept { TestKit::__internal_deallocate( pointer ); }
+void operator delete[]( void* pointer, std::size_t, std::align_val_t ) noexcept { TestKit::__internal_deallocate( pointer ); }
+void operator delete( void* pointer, const std::nothrow_t& ) noexcept { TestKit::__internal_deallocate( pointer ); }
+void operator delete[]( void* pointer, const std::nothrow_t& ) noexcept { TestKit::__internal_deallocate( pointer ); }
+void operator delete( void* pointer, std::align_val_t, const std::nothrow_t& ) noexcept { TestKit::__internal_deallocate( pointer ); }
+void operator delete[]( void* pointer, std::align_val_t, const std::nothrow_t& ) noexcept { TestKit::__internal_deallocate( pointer ); }
+#endif
+
+// ----------------------------------------------------------------------------
+// Macros
+// ----------------------------------------------------------------------------
+#define __INTERNAL_TK_CAT( A, B ) A ## B
+#define __INTERNAL_TK_RECAT( A, B ) __INTERNAL_TK_CAT( A, B )
+#define __INTERNAL_TK_SELECT( NAME, NUM ) __INTERNAL_TK_CAT( NAME ## _, NUM )
+
+#define __INTERNAL_TK_GET_COUNT( _1, _2, COUNT, ... ) COUNT
+#define __INTERNAL_TK_VA_SIZE( ... ) __INTERNAL_TK_GET_COUNT( __VA_ARGS__, 2, 1 )
+
+#define __INTERNAL_TK_VA_SELECT( NAME, ... ) __INTERNAL_TK_SELECT( NAME, __INTERNAL_TK_VA_SIZE(__VA_ARGS__) )(__VA_ARGS__)
+
+#define __INTERNAL_UNIQUE_NAME( NAME ) __INTERNAL_TK_RECAT( NAME, __COUNTER__ )
+
+#define __INTERNAL_TK_REQUIRE_2( msg, condition )                                                   \
+{                                                                                                   \
+    auto top = ::TestKit::__internal_segment_stack.top();                                           \
+    if( top->DidFail() )                                                                            \
+    {                                                                                               \
+        top->AddTask( ::TestKit::Task::Build( msg, std::source_location::current() ) );             \
+    }                                                                                               \
+    else                                                                                            \
+    {                                                                                               \
+        bool c = condition; /* caching to prevent re-evaluation */                                  \
+        if( !c ) { top->MarkFailed(); }                                                             \
+        top->AddTask( ::TestKit::Task::Build( msg, std::source_location::current(), c ) );          \
+    }                                                                                               \
+}
+
+#define __INTERNAL_TK_CHECK_2( msg, condition )                                                     \
+{                                                                                                   \
+    auto top = ::TestKit::__internal_segment_stack.top();                                           \
+    if( top->DidFail() )                                                                            \
+    {                                                                                               \
+        top->AddTask( ::TestKit::Task::Build( msg, std::source_location::current() ) );             \
+    }                                                                                               \
+    else                                                                                            \
+    {                                                                                               \
+        top->AddTask( ::TestKit::Task::Build( msg, std::source_location::current(), condition ) );  \
+    }                                                                                               \
+}
+
+#define __INTERNAL_TK_REQUIRE_1( condition ) __INTERNAL_TK_REQUIRE_2( #condition, condition )
+#define __INTERNAL_TK_CHECK_1( condition ) __INTERNAL_TK_CHECK_2( #condition, condition )
+
+// a failed section skips the condition like CHECK does. The condition may co_await and resume on another thread, so the section is
+// looked at again once it is done, the fallback section then reads the same thread's stack for the failure and the record
+#define __INTERNAL_TK_CO_ASSERT( msg, condition, required )                                                             \
+{                                                                                                                       \
+    bool skipped = __testkit_co_section.DidFail();                                                                      \
+    bool c = skipped ? false : (bool) ( condition ); /* caching to prevent re-evaluation */                             \
+    if( skipped || __testkit_co_section.DidFail() )                                                                     \
+    {                                                                                                                   \
+        __testkit_co_section.Record( ::TestKit::Task::Build( msg, std::source_location::current() ), required );        \
+    }                                                                                                                   \
+    else                                                                                                                \
+    {                                                                                                                   \
+        __testkit_co_section.Record( ::TestKit::Task::Build( msg, std::source_location::current(), c ), required );     \
+    }                                                                                                                   \
+}
+
+#define __INTERNAL_TK_CO_REQUIRE_2( msg, condition ) __INTERNAL_TK_CO_ASSERT( msg, condition, true )
+#define __INTERNAL_TK_CO_CHECK_2( msg, condition ) __INTERNAL_TK_CO_ASSERT( msg, condition, false )
+#define __INTERNAL_TK_CO_REQUIRE_1( condition ) __INTERNAL_TK_CO_REQUIRE_2( #condition, condition )
+#define __INTERNAL_TK_CO_CHECK_1( condition ) __INTERNAL_TK_CO_CHECK_2( #condition, condition )
+
+// the enclosing __testkit_co_section is bound under another name first, the new section then shadows it inside the block
+#define __INTERNAL_TK_CO_SECTION( name, parent ) if( const ::TestKit::AsyncSection& parent = __testkit_co_section; const ::TestKit::AsyncSection __testkit_co_section { name, parent } )
 
 #define SECTION( name ) if( ::TestKit::SegmentScopeManager __INTERNAL_UNIQUE_NAME( __testkit_segment_scope ) = ::TestKit::SegmentScopeManager( name ) )
+#define SECTION_WITH_BUDGET( name, maxPeakBytes ) if( ::TestKit::SegmentScopeManager __INTERNAL_UNIQUE_NAME( __testkit_segment_scope ) = ::TestKit::SegmentScopeManager( name, (uint64_t) ( maxPeakBytes ) ) )
 #define REQUIRE( ... ) __INTERNAL_TK_VA_SELECT( __INTERNAL_TK_REQUIRE, __VA_ARGS__ )
 #define CHECK( ... ) __INTERNAL_TK_VA_SELECT( __INTERNAL_TK_CHECK, __VA_ARGS__ )
+#define CO_SECTION( name ) __INTERNAL_TK_CO_SECTION( name, __INTERNAL_UNIQUE_NAME( __testkit_co_parent ) )
+#define CO_REQUIRE( ... ) __INTERNAL_TK_VA_SELECT( __INTERNAL_TK_CO_REQUIRE, __VA_ARGS__ )
+#define CO_CHECK( ... ) __INTERNAL_TK_VA_SELECT( __INTERNAL_TK_CO_CHECK, __VA_ARGS__ )
+#define RUN_ASYNC( ... ) ::TestKit::RunAsync( ::TestKit::__internal_async_tests( __VA_ARGS__ ), ::TestKit::__internal_split_arguments( #__VA_ARGS__ ) )
+#define CHECK_FASTER_THAN( budget ) ::TestKit::FasterThanCheck( budget ) = [&]() -> void
+#define CHECK_COMPLEXITY( sizes, fn, complexity ) ::TestKit::CheckComplexity( sizes, fn, ::TestKit::Complexity::complexity )
+#define BENCHMARK( ... ) ::TestKit::BenchmarkRunner( __VA_ARGS__ ) = [&]() -> void
+#define BENCHMARK_LATENCY( ... ) ::TestKit::BenchmarkRunner( __VA_ARGS__ ).Latency() = [&]() -> void
+#define BENCHMARK_COMPARE( ... ) ::TestKit::CompareBenchmarks( __VA_ARGS__ )
+#define BENCHMARK_THREADS( name, maxThreads ) ::TestKit::BenchmarkRunner( name ).Threads( maxThreads ) = [&]() -> void
+#define BENCHMARK_MEMORY( name, maxBytes ) ::TestKit::BenchmarkRunner( name ).Memory( maxBytes ) = [&]() -> void
+#define SETUP if( ::TestKit::TimingPause __INTERNAL_UNIQUE_NAME( __testkit_timing_pause ) {} )
+#define STRESS( name, threads, iterations ) ::TestKit::StressRunner( name, threads, iterations ) = [&]() -> void
 
 #endif // TESTKIT_H